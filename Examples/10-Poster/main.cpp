@@ -0,0 +1,27 @@
+# include <Eigen/Dense>
+# include <figure/figure.hpp>
+
+int main () {
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(100000, 0, 100);
+  Eigen::VectorXd y = (x.array().sin()*(-0.05*x.array()).exp()).matrix();
+
+  // the size of the graphic is only kept if plot size and margins are set
+  // as well, otherwise the figure lays itself out around the default plot
+  mgl::Figure fig;
+  fig.setWidth(20000);
+  fig.setHeight(20000);
+  fig.setPlotWidth(19600);
+  fig.setPlotHeight(19600);
+  fig.setTopMargin(200);
+  fig.setLeftMargin(200);
+  fig.plot(x, y, "b").label("damped oscillation");
+  fig.legend();
+
+  // 20000 x 20000 pixels do not fit in memory at once: render bands of
+  // 1000 rows, 4 at a time, and stream them to the file
+  fig.setTileHeight(1000);
+  fig.setLayers(4);
+  fig.save("poster.png");
+
+  return 0;
+}
@@ -0,0 +1,21 @@
+# include <Eigen/Dense>
+# include <figure/figure.hpp>
+
+int main () {
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(200, 1, 100);
+  Eigen::VectorXd y = x.array().sqrt().matrix();
+
+  // a 2x2 grid with the cell at the bottom left left empty
+  mgl::Figure fig;
+  fig.subplot(2, 2, 0).plot(x, y);
+  fig.subplot(2, 2, 1).setlog(true, true);
+  fig.subplot(2, 2, 1).plot(x, y, "r");
+  fig.subplot(2, 2, 3).title("Bars");
+  fig.subplot(2, 2, 3).bar(y.head(10));
+
+  // raster and vector output, the empty cell is skipped in both
+  fig.save("subplots.png");
+  fig.save("subplots.eps");
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+# include <chrono>
+# include <iostream>
+# include <Eigen/Dense>
+# include <figure/figure.hpp>
+
+// render the same figure with 'layers' render layers and return the time in ms
+double timed_save (const int layers, const std::string& file) {
+  const int nseries = 200, n = 20000;
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(n, 0, 10);
+
+  mgl::Figure fig;
+  for (int k = 0; k < nseries; ++k) {
+    Eigen::VectorXd y = ( (x.array() + 0.05*k).sin() + 0.01*k ).matrix();
+    fig.plot(x, y);
+  }
+  fig.setLayers(layers);
+
+  auto start = std::chrono::steady_clock::now();
+  fig.save(file);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main () {
+  const double seq = timed_save(1, "sequential.png"),
+               par = timed_save(4, "layered.png");
+
+  std::cout << "sequential: " << seq << " ms\n"
+            << "4 layers  : " << par << " ms\n"
+            << "speedup   : " << seq/par << "\n";
+  return 0;
+}
@@ -0,0 +1,23 @@
+# include <Eigen/Dense>
+# include <figure/figure.hpp>
+
+int main () {
+  const int nframes = 100;
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(500, 0, 10);
+
+  mgl::Figure fig;
+  fig.ranges(0, 10, -1.1, 1.1); // fixed ranges: axis and grid are drawn only once
+  fig.grid();
+  fig.xlabel("x");
+  fig.beginAnimation("wave.gif", 25);
+
+  for (int k = 0; k < nframes; ++k) {
+    Eigen::VectorXd y = (x.array() - 0.1*k).sin().matrix();
+    fig.clearPlots(); // replace the data of the last frame
+    fig.plot(x, y, "b").label("sin(x - t)");
+    fig.frame();
+  }
+
+  fig.endAnimation();
+  return 0;
+}
@@ -2,11 +2,12 @@
 # once finshed the following variables will be initialized:
 #   FIGURE_INCLUDE_DIR : directory which contains all Figure files
 #   FIGURE_LIBRARY : libFigure.a
+#   FIGURE_LIBRARIES : libFigure.a and the libraries it needs besides MathGL (zlib, threads)
 # ==========================================================================================
 #   Typical usage:    find_package( Figure REQUIRED )
 #                     include_directories( ${FIGURE_INCLUDE_DIR} )
 #                     add_executable( main my_main_file.cpp )
-#                     target_link_libraries( main Figure )
+#                     target_link_libraries( main ${FIGURE_LIBRARIES} ${MATHGL2_LIBRARIES} )
 # ==========================================================================================
 
 if ( DEBUG )
@@ -74,3 +75,9 @@ else()
     message( STATUS "Couldn't find libFigure.a, maybe try (re-)installing with administrator rights?" )
   endif()
 endif()
+
+## ------------- dependencies of libFigure.a ------------ ##
+# PNGs are written with zlib and plots rendered on several threads
+find_package( ZLIB REQUIRED )
+find_package( Threads REQUIRED )
+set( FIGURE_LIBRARIES ${FIGURE_LIBRARY} ${ZLIB_LIBRARIES} ${CMAKE_THREAD_LIBS_INIT} )
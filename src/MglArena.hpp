@@ -0,0 +1,125 @@
+#ifndef MGL_ARENA_HPP
+#define MGL_ARENA_HPP
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace mgl {
+
+/* allocation counters of an arena since its last release(), see MglArena::stats */
+struct MglArenaStats {
+  std::size_t requests; // buffers handed out
+  std::size_t heapAllocations; // blocks allocated on the heap for them
+  std::size_t bytes; // bytes handed out
+};
+
+/* monotonic arena for the temporary buffers of a render pass.              *
+ * Buffers are carved out of large blocks and are never freed one by one,   *
+ * release() drops all of them at once and keeps the blocks for reuse, so   *
+ * warm renders don't touch the heap at all.                                *
+ * NOTE: not thread-safe, every thread of a render pass needs an arena of   *
+ *       its own (see Figure::reserveArenas())                              */
+class MglArena {
+public:
+  explicit MglArena(const std::size_t blockSize = 1 << 20)
+    : blockSize_(blockSize)
+    , current_(0)
+    , offset_(0)
+    , stats_{ 0, 0, 0 }
+  {}
+
+  MglArena(const MglArena&) = delete;
+  MglArena& operator=(const MglArena&) = delete;
+
+  /* get 'bytes' bytes aligned to 'align'                            *
+   * PRE : align is a power of 2                                     *
+   * POST: returns memory valid until the next release() or trim()   */
+  void* allocate(const std::size_t bytes, const std::size_t align = alignof(double)) {
+    stats_.requests += 1;
+    stats_.bytes += bytes;
+
+    // try the current block and the ones kept from earlier passes
+    while (current_ < blocks_.size()) {
+      void* p = carve(blocks_[current_], bytes, align);
+      if (p) {
+        return p;
+      }
+      ++current_;
+      offset_ = 0;
+    }
+
+    // need a new block, large requests get a block of their own
+    stats_.heapAllocations += 1;
+    const std::size_t size = std::max(blockSize_, bytes + align);
+    blocks_.push_back(Block{ std::unique_ptr<char[]>(new char[size]), size });
+    current_ = blocks_.size() - 1;
+    return carve(blocks_[current_], bytes, align);
+  }
+
+  /* get an uninitialized array of n T's                      *
+   * PRE : T is trivially destructible, it will not be destroyed *
+   * POST: returns memory valid until the next release()       */
+  template <typename T>
+  T* allocate_array(const std::size_t n) {
+    return static_cast<T*>(allocate(n*sizeof(T), alignof(T)));
+  }
+
+  /* drop all buffers                                                *
+   * PRE : no buffer of this arena is used anymore                   *
+   * POST: all memory can be handed out again, the blocks are kept.  *
+   *       The counters of stats() start again from 0                */
+  void release() {
+    current_ = 0;
+    offset_ = 0;
+    stats_ = MglArenaStats{ 0, 0, 0 };
+  }
+
+  /* drop all buffers and free the blocks */
+  void trim() {
+    release();
+    blocks_.clear();
+  }
+
+  /* bytes held by this arena */
+  std::size_t capacity() const {
+    std::size_t total = 0;
+    for (auto& b : blocks_) {
+      total += b.size;
+    }
+    return total;
+  }
+
+  /* allocations of this arena since its last release() */
+  MglArenaStats stats() const {
+    return stats_;
+  }
+
+private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    std::size_t size;
+  };
+
+  /* take 'bytes' aligned bytes from b at offset_, nullptr if they don't fit */
+  void* carve(Block& b, const std::size_t bytes, const std::size_t align) {
+    const std::size_t base = reinterpret_cast<std::size_t>(b.data.get()),
+                      start = ((base + offset_ + align - 1) & ~(align - 1)) - base;
+    if (start + bytes > b.size) {
+      return nullptr;
+    }
+    offset_ = start + bytes;
+    return b.data.get() + start;
+  }
+
+  std::size_t blockSize_; // size of newly allocated blocks
+  std::vector<Block> blocks_; // memory of this arena
+  std::size_t current_; // block currently handed out from
+  std::size_t offset_; // first free byte in the current block
+  MglArenaStats stats_; // allocations since the last release()
+};
+
+} // end namespace mgl
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef MGL_CLIP_HPP
+#define MGL_CLIP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mgl2/mgl.h>
+
+namespace mgl {
+
+/* check if data can be clipped by binary search                     *
+ * PRE : -                                                           *
+ * POST: true if all values are finite and in non-decreasing order   */
+inline bool is_sorted_finite(const mglData& d)
+{
+  const long n = d.GetNx();
+  for (long i = 0; i < n; ++i) {
+    if (!std::isfinite(d.a[i]) || (i > 0 && d.a[i] < d.a[i - 1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* check if a series with gaps can be clipped by binary search              *
+ * PRE : -                                                                  *
+ * POST: true if the finite values are in non-decreasing order and the      *
+ *       others are single NaN between two of them, as left by split_gaps() */
+inline bool is_sorted_gaps(const mglData& d)
+{
+  const long n = d.GetNx();
+  double last = -std::numeric_limits<double>::infinity();
+  for (long i = 0; i < n; ++i) {
+    if (std::isnan(d.a[i]) && i > 0 && i + 1 < n && !std::isnan(d.a[i - 1])) {
+      continue;
+    }
+    if (!std::isfinite(d.a[i]) || d.a[i] < last) {
+      return false;
+    }
+    last = d.a[i];
+  }
+  return true;
+}
+
+/* visible window of sorted data                                          *
+ * PRE : x[0..n) sorted, see is_sorted_finite() or is_sorted_gaps()       *
+ * POST: returns the number of points in the window, its first index is   *
+ *       written to begin. One point beyond each boundary is kept so line *
+ *       segments crossing the boundaries are drawn correctly             */
+inline long clip_sorted(const double* x, const long n, const double lo, const double hi, long& begin)
+{
+  // a NaN gap is searched as if it had the value before it
+  const auto key = [x](const long i) { return std::isnan(x[i]) ? x[i - 1] : x[i]; };
+  long first = 0, last = 0;
+  for (long count = n; count > 0; ) { // first key >= lo
+    const long half = count/2;
+    if (key(first + half) < lo) {
+      first += half + 1;
+      count -= half + 1;
+    }
+    else {
+      count = half;
+    }
+  }
+  for (long count = n; count > 0; ) { // first key > hi
+    const long half = count/2;
+    if (!(hi < key(last + half))) {
+      last += half + 1;
+      count -= half + 1;
+    }
+    else {
+      count = half;
+    }
+  }
+  first = std::max(0L, first - 1);
+  last = std::min(n, last + 1);
+  begin = first;
+  return std::max(0L, last - first);
+}
+
+/* clip a polyline in 'dims' dimensions to the box [lo, hi]                 *
+ * PRE : in[d] and out[d] point to n values for d < dims, keep to n flags   *
+ * POST: all points of the segments whose bounding box intersects the box  *
+ *       are written to out, runs of kept points are separated by NaN so no *
+ *       false segments are drawn. Returns the number of written values     *
+ *       (never more than n). NaN in the input are kept                     */
+inline long clip_polyline(const double* const* in, const int dims, const long n,
+                          const double* lo, const double* hi, double* const* out,
+                          unsigned char* keep)
+{
+  if (n == 0) {
+    return 0;
+  }
+
+  // predicate pass: keep[i] is set if segment i -> i+1 may be visible.
+  // written as plain loops over the arrays so the compiler can vectorize them
+  std::fill(keep, keep + n, 1);
+  for (int d = 0; d < dims; ++d) {
+    const double* c = in[d];
+    const double l = lo[d], h = hi[d];
+    for (long i = 0; i + 1 < n; ++i) {
+      const bool below = c[i] < l && c[i + 1] < l,
+                 above = c[i] > h && c[i + 1] > h;
+      keep[i] &= !(below || above);
+    }
+  }
+  // a single point is only kept if it is inside
+  if (n == 1) {
+    for (int d = 0; d < dims; ++d) {
+      keep[0] &= !(in[d][0] < lo[d] || in[d][0] > hi[d]);
+    }
+  }
+  else {
+    keep[n - 1] = 0;
+  }
+
+  // compaction pass: point i is needed if segment i-1 or segment i is kept
+  long m = 0;
+  bool gap = false;
+  for (long i = 0; i < n; ++i) {
+    const bool needed = keep[i] || (i > 0 && keep[i - 1]);
+    if (!needed) {
+      gap = m > 0;
+      continue;
+    }
+    if (gap) {
+      for (int d = 0; d < dims; ++d) {
+        out[d][m] = std::numeric_limits<double>::quiet_NaN();
+      }
+      ++m;
+      gap = false;
+    }
+    for (int d = 0; d < dims; ++d) {
+      out[d][m] = in[d][i];
+    }
+    ++m;
+  }
+  return m;
+}
+
+/* clip single points in 'dims' dimensions to the box [lo, hi]                 *
+ * PRE : in[d] and out[d] point to n values for d < dims, inside to n flags    *
+ * POST: the points inside the box are written to out, returns how many        */
+inline long clip_points(const double* const* in, const int dims, const long n,
+                        const double* lo, const double* hi, double* const* out,
+                        unsigned char* inside)
+{
+  std::fill(inside, inside + n, 1);
+  for (int d = 0; d < dims; ++d) {
+    const double* c = in[d];
+    const double l = lo[d], h = hi[d];
+    for (long i = 0; i < n; ++i) {
+      inside[i] &= !(c[i] < l || c[i] > h);
+    }
+  }
+
+  long m = 0;
+  for (long i = 0; i < n; ++i) {
+    if (inside[i]) {
+      for (int d = 0; d < dims; ++d) {
+        out[d][m] = in[d][i];
+      }
+      ++m;
+    }
+  }
+  return m;
+}
+
+} // end namespace mgl
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef MGL_DAEMON_HPP
+#define MGL_DAEMON_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <ostream>
+#include <istream>
+#include <streambuf>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "figure.hpp"
+#ifdef __linux__
+  #include <cerrno>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+#endif
+
+namespace mgl {
+
+/* protocol between the clients and the render daemon tools/figure-renderd    *
+ * A client connects to the Unix socket of the daemon and sends a Request     *
+ * with two file descriptors attached (SCM_RIGHTS): a memfd holding the scene *
+ * of the figure (see MglScene.hpp) and the regular file (or memfd) to write  *
+ * the output to. The daemon renders the scene on one of its workers, writes  *
+ * the output and answers with a Reply. Only the descriptors go through the   *
+ * socket, the plot data is shared, and both sides run on the same machine,  *
+ * so the messages are in native byte order                                  */
+namespace MglDaemon {
+  const std::uint32_t version = 1;
+
+  // environment variable holding the socket of the daemon Figure::save uses
+  const char* const socketVariable = "FIGURE_RENDERD";
+
+  struct Request {
+    std::uint32_t version;
+    char format[16]; // extension of the output format, e.g. ".png", zero terminated
+  };
+
+  struct Reply {
+    std::uint64_t bytes; // size of the output, 0 on failure
+  };
+}
+
+/* socket of the daemon Figure::save uses, empty if none is set */
+inline std::string daemon_socket()
+{
+  const char* socket = std::getenv(MglDaemon::socketVariable);
+  return socket ? std::string(socket) : std::string();
+}
+
+/* output stream buffer writing to a file descriptor, which is not closed */
+class MglFdBuf : public std::streambuf {
+public:
+  explicit MglFdBuf(const int fd)
+    : fd_(fd)
+  {
+    setp(buffer_, buffer_ + sizeof(buffer_));
+  }
+
+  ~MglFdBuf() {
+    sync();
+  }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (sync() != 0) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override {
+    const bool ok = flush(pbase(), std::size_t(pptr() - pbase()));
+    setp(buffer_, buffer_ + sizeof(buffer_));
+    return ok ? 0 : -1;
+  }
+
+private:
+  bool flush(const char* p, std::size_t n) {
+#ifdef __linux__
+    while (n > 0) {
+      const ssize_t written = ::write(fd_, p, n);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      p += written;
+      n -= std::size_t(written);
+    }
+    return true;
+#else
+    return n == 0;
+#endif
+  }
+
+  int fd_;
+  char buffer_[1 << 16];
+};
+
+/* input stream buffer over memory, e.g. a mapped scene, without a copy *
+ * NOTE: it can seek, so MglSceneReader knows how many bytes are left   */
+class MglMemoryBuf : public std::streambuf {
+public:
+  MglMemoryBuf(const char* data, const std::size_t n) {
+    char* p = const_cast<char*>(data); // only read
+    setg(p, p, p + n);
+  }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    const off_type base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? gptr() - eback() : egptr() - eback();
+    const off_type pos = base + off;
+    if (!(which & std::ios_base::in) || pos < 0 || pos > egptr() - eback()) {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+
+#ifdef __linux__
+
+/* send a message with file descriptors attached                 *
+ * PRE : socket is a connected SOCK_SEQPACKET Unix socket         *
+ * POST: returns false if the message could not be sent          */
+inline bool send_fds(const int socket, const void* msg, const std::size_t n, const int* fds, const int nfds)
+{
+  iovec iov;
+  iov.iov_base = const_cast<void*>(msg);
+  iov.iov_len = n;
+
+  union {
+    cmsghdr align;
+    char buffer[CMSG_SPACE(2*sizeof(int))];
+  } control;
+  std::memset(&control, 0, sizeof(control));
+
+  msghdr header;
+  std::memset(&header, 0, sizeof(header));
+  header.msg_iov = &iov;
+  header.msg_iovlen = 1;
+  if (nfds > 0) {
+    header.msg_control = control.buffer;
+    header.msg_controllen = CMSG_SPACE(nfds*sizeof(int));
+    cmsghdr* c = CMSG_FIRSTHDR(&header);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(nfds*sizeof(int));
+    std::memcpy(CMSG_DATA(c), fds, nfds*sizeof(int));
+  }
+
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(socket, &header, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  return sent == ssize_t(n);
+}
+
+/* receive a message of n bytes and up to 2 file descriptors                *
+ * PRE : socket is a connected SOCK_SEQPACKET Unix socket                   *
+ * POST: returns the size of the message, 0 if the peer closed the         *
+ *       connection and -1 on errors. The received descriptors are in fds,  *
+ *       their number in nfds, the caller has to close them                 */
+inline long recv_fds(const int socket, void* msg, const std::size_t n, int* fds, int& nfds)
+{
+  iovec iov;
+  iov.iov_base = msg;
+  iov.iov_len = n;
+
+  union {
+    cmsghdr align;
+    char buffer[CMSG_SPACE(2*sizeof(int))];
+  } control;
+
+  msghdr header;
+  std::memset(&header, 0, sizeof(header));
+  header.msg_iov = &iov;
+  header.msg_iovlen = 1;
+  header.msg_control = control.buffer;
+  header.msg_controllen = sizeof(control.buffer);
+
+  ssize_t received;
+  do {
+    received = ::recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+
+  nfds = 0;
+  for (cmsghdr* c = CMSG_FIRSTHDR(&header); received >= 0 && c; c = CMSG_NXTHDR(&header, c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+      const int count = int((c->cmsg_len - CMSG_LEN(0))/sizeof(int));
+      for (int i = 0; i < count; ++i) {
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(c) + i*sizeof(int), sizeof(int));
+        if (nfds < 2) {
+          fds[nfds++] = fd;
+        }
+        else {
+          ::close(fd);
+        }
+      }
+    }
+  }
+  return long(received);
+}
+
+/* address of the Unix socket at 'path'                                  *
+ * PRE : -                                                               *
+ * POST: returns false if the path does not fit into a socket address    */
+inline bool daemon_address(const std::string& path, sockaddr_un& address)
+{
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+/* send one request on a connection and wait for the reply                 *
+ * PRE : connection is a connected SOCK_SEQPACKET Unix socket to a daemon    *
+ *       or a pool worker, scene and output as for daemon_render             *
+ * POST: bytes holds the size of the output (0 if rendering failed).        *
+ *       Returns false if the connection broke, e.g. the worker crashed      */
+inline bool daemon_request(const int connection, const int scene, const std::string& format, const int output,
+                           std::size_t& bytes)
+{
+  bytes = 0;
+  MglDaemon::Request request;
+  std::memset(&request, 0, sizeof(request));
+  if (format.size() >= sizeof(request.format)) {
+    return true; // no format has such a long extension
+  }
+  request.version = MglDaemon::version;
+  std::memcpy(request.format, format.c_str(), format.size());
+
+  const int fds[2] = { scene, output };
+  if (!send_fds(connection, &request, sizeof(request), fds, 2)) {
+    return false;
+  }
+  MglDaemon::Reply reply;
+  int received[2], nreceived;
+  const long n = recv_fds(connection, &reply, sizeof(reply), received, nreceived);
+  for (int i = 0; i < nreceived; ++i) {
+    ::close(received[i]);
+  }
+  if (n != long(sizeof(reply))) {
+    return false;
+  }
+  bytes = std::size_t(reply.bytes);
+  return true;
+}
+
+/* render a scene in the daemon listening on 'socket'                        *
+ * PRE : scene holds a scene at offset 0, output is a regular file or memfd  *
+ *       open for writing, format is the extension of a registered format    *
+ * POST: the daemon has written the output, returns its size. Returns 0 if   *
+ *       the daemon could not be reached or failed to render the scene       */
+inline std::size_t daemon_render(const std::string& socket, const int scene, const std::string& format, const int output)
+{
+  sockaddr_un address;
+  if (!daemon_address(socket, address)) {
+    return 0;
+  }
+  const int connection = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (connection < 0) {
+    return 0;
+  }
+  std::size_t bytes = 0;
+  if (::connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+    daemon_request(connection, scene, format, output, bytes);
+  }
+  ::close(connection);
+  return bytes;
+}
+
+/* scene of a figure in shared memory                                      *
+ * PRE : scene writes the scene of the figure to a stream                  *
+ * POST: returns a memfd holding the scene, -1 if it could not be written  */
+inline int scene_memfd(const std::function<bool(std::ostream&)>& scene)
+{
+  const int memory = ::memfd_create("figure-scene", MFD_CLOEXEC);
+  if (memory < 0) {
+    return -1;
+  }
+  bool written;
+  {
+    MglFdBuf buffer(memory);
+    std::ostream out(&buffer);
+    written = scene(out) && bool(out.flush());
+  }
+  if (!written) {
+    ::close(memory);
+    return -1;
+  }
+  return memory;
+}
+
+/* can a daemon or pool worker write 'format'?                               *
+ * NOTE: MathGL compresses only if the file name ends with 'z', which the    *
+ *       renderer can't see (it writes to /proc/self/fd/..), so compressed   *
+ *       formats are rendered by the calling process                         */
+inline bool daemon_format(const std::string& format)
+{
+  return !format.empty() && format[format.size() - 1] != 'z';
+}
+
+/* save a figure with the daemon listening on 'socket'                      *
+ * PRE : scene writes the scene of the figure to a stream                   *
+ * POST: the scene is written to a memfd the daemon maps, the daemon writes  *
+ *       'file' in 'format'. Returns the size of the file, 0 if the daemon   *
+ *       could not be used (then the caller renders the figure itself)       */
+inline std::size_t daemon_save(const std::string& socket, const std::string& file, const std::string& format,
+                               const std::function<bool(std::ostream&)>& scene)
+{
+  if (!daemon_format(format)) {
+    return 0;
+  }
+  const int memory = scene_memfd(scene);
+  if (memory < 0) {
+    return 0;
+  }
+  std::size_t bytes = 0;
+  const int output = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (output >= 0) {
+    bytes = daemon_render(socket, memory, format, output);
+    ::close(output);
+  }
+  ::close(memory);
+  return bytes;
+}
+
+/* render one request in this process                                         *
+ * PRE : scene and output are the descriptors sent with the request           *
+ * POST: output holds the figure of the scene, drawn on graph. Returns the    *
+ *       number of bytes written, 0 on failure                                */
+inline std::size_t daemon_render_request(const MglDaemon::Request& request, const int scene, const int output,
+                                         mglGraph& graph)
+{
+  const std::string format(request.format, ::strnlen(request.format, sizeof(request.format)));
+  struct stat sceneStat, outputStat;
+  if (request.version != MglDaemon::version || format.size() == sizeof(request.format)
+      || ::fstat(scene, &sceneStat) != 0 || ::fstat(output, &outputStat) != 0
+      || !S_ISREG(sceneStat.st_mode) || !S_ISREG(outputStat.st_mode) || sceneStat.st_size <= 0) {
+    std::cerr << "In function daemon_render_request(): Invalid request\n";
+    return 0;
+  }
+
+  // the scene is read in place, the only copy is the one into the plots
+  const std::size_t size = std::size_t(sceneStat.st_size);
+  void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, scene, 0);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "In function daemon_render_request(): Could not map the scene\n";
+    return 0;
+  }
+  Figure fig;
+  bool ok;
+  {
+    MglMemoryBuf buffer(static_cast<const char*>(mapped), size);
+    std::istream in(&buffer);
+    ok = fig.deserialize(in);
+  }
+  ::munmap(mapped, size);
+  if (!ok) {
+    return 0;
+  }
+
+  // writers open files by name, the name of the descriptor is enough
+  fig.save("/proc/self/fd/" + std::to_string(output), format, &graph);
+  return fig.renderStats().bytesWritten;
+}
+
+/* load the fonts and touch MathGL's code paths with a small figure, so the *
+ * first client does not wait for them                                      */
+inline void daemon_warm_up(mglGraph& graph)
+{
+  const int warm = ::memfd_create("figure-warmup", MFD_CLOEXEC);
+  if (warm >= 0) {
+    Figure fig;
+    fig.plot(std::vector<double>{ 1, 2, 3 }, std::vector<double>{ 1, 4, 9 });
+    fig.save("/proc/self/fd/" + std::to_string(warm), ".png", &graph);
+    ::close(warm);
+  }
+}
+
+/* answer the requests of one connection                              *
+ * PRE : connection is a connected SOCK_SEQPACKET Unix socket          *
+ * POST: returns when the peer closed the connection or it broke       */
+inline void daemon_serve(const int connection, mglGraph& graph)
+{
+  MglDaemon::Request request;
+  int fds[2], nfds = 0;
+  while (recv_fds(connection, &request, sizeof(request), fds, nfds) == long(sizeof(request))) {
+    MglDaemon::Reply reply = { 0 };
+    if (nfds == 2) {
+      reply.bytes = daemon_render_request(request, fds[0], fds[1], graph);
+    }
+    for (int i = 0; i < nfds; ++i) {
+      ::close(fds[i]);
+    }
+    nfds = 0;
+    if (!send_fds(connection, &reply, sizeof(reply), nullptr, 0)) {
+      break;
+    }
+  }
+  for (int i = 0; i < nfds; ++i) {
+    ::close(fds[i]);
+  }
+}
+
+#else // no Unix sockets and memfds: figures are always rendered in the process
+
+inline bool daemon_format(const std::string&)
+{
+  return false;
+}
+
+inline std::size_t daemon_save(const std::string&, const std::string&, const std::string&,
+                               const std::function<bool(std::ostream&)>&)
+{
+  return 0;
+}
+
+#endif
+
+} // end namespace mgl
+
+#endif
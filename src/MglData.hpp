@@ -0,0 +1,233 @@
+#ifndef MGL_DATA_HPP
+#define MGL_DATA_HPP
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <numeric>
+#include "FigureConfig.hpp"
+#include "MglParallel.hpp"
+#if FIG_HAS_EIGEN
+  #include <Eigen/Dense>
+#endif
+#include <mgl2/mgl.h>
+
+namespace mgl {
+
+/* make mglData from std::vector                                    *
+ * PRE: -                                                           *
+ * POST: returning mglData containing the data of given std::vector */
+template<typename Scalar>
+typename std::enable_if<std::is_arithmetic<Scalar>::value, mglData>::type
+make_mgldata(const std::vector<Scalar>& v) {
+  mglData d(long(v.size()));
+  std::copy(v.begin(), v.end(), d.a);
+  return d;
+}
+
+/* make mglData from an Eigen vector or vector expression                  *
+ * PRE : vec has one row or one column                                     *
+ * POST: returning mglData containing the coefficients of vec, evaluated   *
+ *       in one pass with Eigen's vectorized evaluation straight into the  *
+ *       storage of the mglData. Expressions are not materialized before,  *
+ *       strided maps (e.g. a row of a column-major matrix) are gathered   *
+ *       in the same pass                                                  */
+#if FIG_HAS_EIGEN
+template<typename Derived>
+mglData make_mgldata(const Eigen::MatrixBase<Derived>& vec) {
+  assert(vec.rows() == 1 || vec.cols() == 1);
+  mglData d(long(vec.size()));
+  // the coefficients of a row or column are stored one after the other in either shape
+  Eigen::Map<Eigen::Matrix<mreal, Eigen::Dynamic, Eigen::Dynamic> >(d.a, vec.rows(), vec.cols())
+    = vec.template cast<mreal>();
+  return d;
+}
+
+/* make mglData from an Eigen array expression, e.g. (0.2*u.array()).cos() *
+ * PRE : vec has one row or one column                                     *
+ * POST: see the Eigen vector version                                      */
+template<typename Derived>
+mglData make_mgldata(const Eigen::ArrayBase<Derived>& vec) {
+  return make_mgldata(vec.matrix());
+}
+
+/* make mglData from an Eigen::Matrix, for surface and field plots           *
+ * PRE : -                                                                  *
+ * POST: returning mglData with Z.cols() columns and Z.rows() rows, copied  *
+ *       in one pass with Eigen's vectorized evaluation, no temporary       */
+template<typename Derived>
+mglData make_mgldata_field(const Eigen::MatrixBase<Derived>& Z) {
+  mglData d(Z.cols(), Z.rows());
+  Eigen::Map<Eigen::Matrix<mreal, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> >(d.a, Z.rows(), Z.cols())
+    = Z.template cast<mreal>();
+  return d;
+}
+#endif
+
+/* log10 of n values, for data drawn on pretransformed log axes              *
+ * PRE : in and out point to n values                                        *
+ * POST: out[i] = log10(in[i]), NaN for values that are not positive, so    *
+ *       lines have a gap there. Chunks are transformed in parallel, with   *
+ *       Eigen's vectorized log if Eigen is available                       */
+inline void log10_positive(const double* in, const long n, double* out)
+{
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const unsigned chunks = unsigned(std::min<long>(hardware_threads(), 1 + n/(1 << 16)));
+  parallel_chunks(std::size_t(n), chunks, [&](std::size_t begin, std::size_t end, unsigned) {
+#if FIG_HAS_EIGEN
+    const Eigen::Map<const Eigen::ArrayXd> x(in + begin, long(end - begin));
+    Eigen::Map<Eigen::ArrayXd>(out + begin, long(end - begin)) = (x > 0).select(x.log10(), nan);
+#else
+    for (std::size_t i = begin; i < end; ++i) {
+      out[i] = in[i] > 0 ? std::log10(in[i]) : nan;
+    }
+#endif
+  });
+}
+
+/* merge the gaps of a series, so all its segments are drawn by one plot      *
+ * PRE : d[k] point to mglData with n values each, for k < dims               *
+ * POST: a point with NaN or Inf on any axis is a gap. Runs of gaps become    *
+ *       one NaN point on all axes, where MathGL breaks the line, gaps at the *
+ *       ends are dropped (a series without valid points keeps one NaN).      *
+ *       Returns the number of segments. The data are only rewritten if there *
+ *       are gaps, they are found in one pass over chunks in parallel, with   *
+ *       Eigen's vectorized isFinite if Eigen is available                    */
+inline long split_gaps(mglData* const* d, const int dims)
+{
+  const long n = d[0]->GetNx();
+  const unsigned chunks = unsigned(std::min<long>(hardware_threads(), 1 + n/(1 << 16)));
+  std::vector<long> invalid(chunks, 0);
+  parallel_chunks(std::size_t(n), chunks, [&](std::size_t begin, std::size_t end, unsigned chunk) {
+#if FIG_HAS_EIGEN
+    Eigen::Array<bool, Eigen::Dynamic, 1> finite = Eigen::Array<bool, Eigen::Dynamic, 1>::Ones(long(end - begin));
+    for (int k = 0; k < dims; ++k) {
+      finite = finite && Eigen::Map<const Eigen::ArrayXd>(d[k]->a + begin, long(end - begin)).isFinite();
+    }
+    invalid[chunk] = long(end - begin) - long(finite.count());
+#else
+    for (std::size_t i = begin; i < end; ++i) {
+      bool finite = true;
+      for (int k = 0; k < dims; ++k) {
+        finite = finite && std::isfinite(d[k]->a[i]);
+      }
+      invalid[chunk] += !finite;
+    }
+#endif
+  });
+  if (std::accumulate(invalid.begin(), invalid.end(), 0L) == 0) {
+    return n > 0 ? 1 : 0;
+  }
+
+  // compaction: keep the valid points and one NaN for every inner gap
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  std::vector<std::vector<double> > out(dims);
+  for (auto& o : out) {
+    o.reserve(std::size_t(n));
+  }
+  long segments = 0;
+  bool gap = true; // in a gap, or before the first segment
+  for (long i = 0; i < n; ++i) {
+    bool finite = true;
+    for (int k = 0; k < dims; ++k) {
+      finite = finite && std::isfinite(d[k]->a[i]);
+    }
+    if (!finite) {
+      gap = true;
+      continue;
+    }
+    if (gap) {
+      if (segments > 0) {
+        for (auto& o : out) {
+          o.push_back(nan);
+        }
+      }
+      ++segments;
+      gap = false;
+    }
+    for (int k = 0; k < dims; ++k) {
+      out[k].push_back(d[k]->a[i]);
+    }
+  }
+  for (int k = 0; k < dims; ++k) {
+    if (segments == 0) {
+      out[k].push_back(nan); // MathGL data have at least one value
+    }
+    d[k]->Set(out[k].data(), long(out[k].size()));
+  }
+  return segments;
+}
+
+/* extent of the data of a plot on one axis, kept by the plot so the auto  *
+ * ranges of a figure can be found without looking at the data again       */
+struct MglRange {
+  double min, max; // finite values, min > max if there are none
+  double minPositive; // smallest value > 0 (for log axes), max() of double if there is none
+
+  bool empty() const {
+    return min > max;
+  }
+};
+
+/* range without values */
+inline MglRange empty_range()
+{
+  return MglRange{ std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(),
+                   std::numeric_limits<double>::max() };
+}
+
+/* range of the finite values of n values                         *
+ * PRE : -                                                        *
+ * POST: returns the range, empty if no value is finite           */
+inline MglRange data_range(const double* a, const long n)
+{
+  MglRange r = empty_range();
+  for (long i = 0; i < n; ++i) {
+    if (std::isfinite(a[i])) {
+      r.min = std::min(r.min, a[i]);
+      r.max = std::max(r.max, a[i]);
+      if (a[i] > 0) {
+        r.minPositive = std::min(r.minPositive, a[i]);
+      }
+    }
+  }
+  return r;
+}
+
+inline MglRange data_range(const mglData& d)
+{
+  return data_range(d.a, long(d.GetNx())*d.GetNy()*d.GetNz());
+}
+
+/* move the values of 'from' into 'to', without copying them                *
+ * PRE : -                                                                 *
+ * POST: 'to' holds the values and size 'from' had and the other way round */
+inline void swap_data(mglData& to, mglData& from)
+{
+  std::swap(to.a, from.a);
+  std::swap(to.nx, from.nx);
+  std::swap(to.ny, from.ny);
+  std::swap(to.nz, from.nz);
+  std::swap(to.link, from.link);
+}
+
+/* bytes of the values held by d, 0 if d only links to the values of others */
+inline std::size_t data_bytes(const mglData& d)
+{
+  return d.link ? 0 : sizeof(*d.a)*std::size_t(d.GetNx())*d.GetNy()*d.GetNz();
+}
+
+/* range covering the interval [lo, hi] */
+inline MglRange span_range(const double lo, const double hi)
+{
+  return MglRange{ lo, hi, lo > 0 ? lo : std::numeric_limits<double>::max() };
+}
+
+} // end namespace mgl
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef MGL_HISTOGRAM_HPP
+#define MGL_HISTOGRAM_HPP
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include "MglParallel.hpp"
+
+namespace mgl {
+
+/* bounding box of the finite points (x[i], y[i]), i < n                    *
+ * PRE : x and y have at least n entries, accessible with operator[]        *
+ * POST: returns {xMin, xMax, yMin, yMax}, min > max if there is no finite  *
+ *       point. Runs in parallel, one pass over the data                    */
+template <typename xVector, typename yVector>
+std::array<double, 4> extent2d(const xVector& x, const yVector& y, const std::size_t n)
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  const unsigned chunks = hardware_threads();
+  std::vector<std::array<double, 4> > partial(chunks, std::array<double, 4>{{inf, -inf, inf, -inf}});
+
+  parallel_chunks(n, chunks, [&](std::size_t begin, std::size_t end, unsigned k) {
+    std::array<double, 4> box = partial[k];
+    for (std::size_t i = begin; i < end; ++i) {
+      const double xi = double(x[i]), yi = double(y[i]);
+      if (std::isfinite(xi) && std::isfinite(yi)) {
+        box[0] = std::min(box[0], xi);
+        box[1] = std::max(box[1], xi);
+        box[2] = std::min(box[2], yi);
+        box[3] = std::max(box[3], yi);
+      }
+    }
+    partial[k] = box;
+  });
+
+  std::array<double, 4> box = partial[0];
+  for (auto& p : partial) {
+    box[0] = std::min(box[0], p[0]);
+    box[1] = std::max(box[1], p[1]);
+    box[2] = std::min(box[2], p[2]);
+    box[3] = std::max(box[3], p[3]);
+  }
+  return box;
+}
+
+/* count the points (x[i], y[i]), i < n in a grid of nx x ny cells on box   *
+ * PRE : box = {xMin, xMax, yMin, yMax} with min < max, counts has nx*ny    *
+ *       entries                                                            *
+ * POST: counts[i + nx*j] is the number of points in cell (i, j), points    *
+ *       outside the box or not finite are not counted. Every thread counts *
+ *       its chunk into a grid of its own, the grids are summed at the end  */
+template <typename xVector, typename yVector>
+void bin2d(const xVector& x, const yVector& y, const std::size_t n,
+           const std::array<double, 4>& box, const long nx, const long ny, double* counts)
+{
+  const double sx = nx/(box[1] - box[0]),
+               sy = ny/(box[3] - box[2]);
+  const std::size_t cells = std::size_t(nx)*ny;
+  // more threads than needed for small inputs only cost the grids
+  const unsigned chunks = unsigned(std::min<std::size_t>(hardware_threads(), 1 + n/(1 << 16)));
+  std::vector<std::vector<unsigned> > partial(chunks);
+
+  parallel_chunks(n, chunks, [&](std::size_t begin, std::size_t end, unsigned k) {
+    std::vector<unsigned> grid(cells, 0);
+    for (std::size_t i = begin; i < end; ++i) {
+      const double u = (double(x[i]) - box[0])*sx,
+                   v = (double(y[i]) - box[2])*sy;
+      // also false for NaN
+      if (u >= 0 && u <= nx && v >= 0 && v <= ny) {
+        // points on the upper boundary belong to the last cell
+        const long ci = std::min(long(u), nx - 1),
+                   cj = std::min(long(v), ny - 1);
+        ++grid[ci + nx*cj];
+      }
+    }
+    partial[k].swap(grid);
+  });
+
+  std::fill(counts, counts + cells, 0.);
+  for (auto& grid : partial) {
+    for (std::size_t c = 0; c < grid.size(); ++c) {
+      counts[c] += grid[c];
+    }
+  }
+}
+
+/* range of the finite values data[i], i < n                                *
+ * PRE : data has at least n entries, accessible with operator[]            *
+ * POST: returns {min, max}, min > max if there is no such value. If        *
+ *       positive is true only values > 0 are considered (for log scaling)  */
+template <typename Vector>
+std::array<double, 2> extent1d(const Vector& data, const std::size_t n, const bool positive = false)
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  const unsigned chunks = hardware_threads();
+  std::vector<std::array<double, 2> > partial(chunks, std::array<double, 2>{{inf, -inf}});
+
+  parallel_chunks(n, chunks, [&](std::size_t begin, std::size_t end, unsigned k) {
+    double lo = inf, hi = -inf;
+    for (std::size_t i = begin; i < end; ++i) {
+      const double v = double(data[i]);
+      if (std::isfinite(v) && (!positive || v > 0)) {
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+      }
+    }
+    partial[k] = std::array<double, 2>{{lo, hi}};
+  });
+
+  std::array<double, 2> range = partial[0];
+  for (auto& p : partial) {
+    range[0] = std::min(range[0], p[0]);
+    range[1] = std::max(range[1], p[1]);
+  }
+  return range;
+}
+
+/* histogram with fixed bins that can be filled chunk by chunk, e.g. while  *
+ * streaming data from disk. Only the counts are kept, not the data.        */
+class MglHistogram {
+public:
+  /* nbins bins of equal width on [min, max], or of equal width in log10    *
+   * space if logBins is true (then min must be > 0)                        */
+  MglHistogram(const double min, const double max, const int nbins, const bool logBins = false)
+    : mode_(logBins ? Log : Uniform)
+    , counts_(std::max(1, nbins), 0.)
+  {
+    const int n = int(counts_.size());
+    const double lo = logBins ? std::log10(min) : min,
+                 hi = logBins ? std::log10(max) : max;
+    // degenerate ranges get one unit around the value
+    lo_ = (hi > lo) ? lo : lo - 0.5;
+    scale_ = n / ((hi > lo ? hi : lo + 0.5) - lo_);
+
+    edges_.resize(n + 1);
+    for (int i = 0; i <= n; ++i) {
+      const double e = lo_ + i/scale_;
+      edges_[i] = logBins ? std::pow(10., e) : e;
+    }
+  }
+
+  /* bins between the given edges, edges must be sorted */
+  explicit MglHistogram(const std::vector<double>& edges)
+    : mode_(Edges)
+    , edges_(edges)
+    , counts_(edges.size() > 1 ? edges.size() - 1 : 1, 0.)
+    , lo_(0)
+    , scale_(1)
+  {
+    if (edges_.size() < 2) {
+      std::cerr << "In function MglHistogram::MglHistogram(): At least two edges are needed!";
+      edges_ = {0, 1};
+    }
+  }
+
+  /* count the values of a chunk of data                                    *
+   * PRE : data has size() and operator[]                                   *
+   * POST: the finite values inside the bins are added to the counts. The   *
+   *       chunk is counted in parallel, every thread into counts of its own */
+  template <typename Vector>
+  void add(const Vector& data) {
+    add(data, std::size_t(data.size()));
+  }
+
+  template <typename Vector>
+  void add(const Vector& data, const std::size_t n) {
+    const std::size_t nbins = counts_.size();
+    const unsigned chunks = unsigned(std::min<std::size_t>(hardware_threads(), 1 + n/(1 << 16)));
+    std::vector<std::vector<std::size_t> > partial(chunks);
+
+    parallel_chunks(n, chunks, [&](std::size_t begin, std::size_t end, unsigned k) {
+      std::vector<std::size_t> bins(nbins, 0);
+      for (std::size_t i = begin; i < end; ++i) {
+        const long b = bin(double(data[i]));
+        if (b >= 0) {
+          ++bins[b];
+        }
+      }
+      partial[k].swap(bins);
+    });
+
+    for (auto& bins : partial) {
+      for (std::size_t b = 0; b < bins.size(); ++b) {
+        counts_[b] += bins[b];
+      }
+    }
+  }
+
+  /* bin of value v, -1 if it is not in any bin */
+  long bin(double v) const {
+    const long n = long(counts_.size());
+    if (mode_ == Edges) {
+      // also false for NaN
+      if (!(v >= edges_.front() && v <= edges_.back())) {
+        return -1;
+      }
+      const long b = long(std::upper_bound(edges_.begin(), edges_.end(), v) - edges_.begin()) - 1;
+      return std::min(b, n - 1);
+    }
+    if (mode_ == Log) {
+      v = v > 0 ? std::log10(v) : std::numeric_limits<double>::quiet_NaN();
+    }
+    const double u = (v - lo_)*scale_;
+    if (!(u >= 0 && u <= n)) {
+      return -1;
+    }
+    // values on the upper edge belong to the last bin
+    return std::min(long(u), n - 1);
+  }
+
+  const std::vector<double>& edges() const {
+    return edges_;
+  }
+
+  const std::vector<double>& counts() const {
+    return counts_;
+  }
+
+  /* centers of the bins, geometric centers for log bins */
+  std::vector<double> centers() const {
+    std::vector<double> c(counts_.size());
+    for (std::size_t i = 0; i < c.size(); ++i) {
+      c[i] = (mode_ == Log) ? std::sqrt(edges_[i]*edges_[i + 1]) : 0.5*(edges_[i] + edges_[i + 1]);
+    }
+    return c;
+  }
+
+private:
+  enum Mode { Uniform, Log, Edges };
+
+  Mode mode_; // how values are mapped to bins
+  std::vector<double> edges_; // nbins + 1 bin edges
+  std::vector<double> counts_; // count of every bin
+  double lo_; // lower edge, log10 of it for log bins
+  double scale_; // bins per unit (of log10 for log bins)
+};
+
+} // end namespace mgl
+
+#endif
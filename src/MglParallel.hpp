@@ -0,0 +1,53 @@
+#ifndef MGL_PARALLEL_HPP
+#define MGL_PARALLEL_HPP
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace mgl {
+
+/* number of threads the hardware can run concurrently           *
+ * PRE : -                                                       *
+ * POST: returns at least 1, also if the number is not computable */
+inline unsigned hardware_threads()
+{
+  const unsigned n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+/* split [0, n) in 'chunks' contiguous chunks and call f(begin, end, chunk) *
+ * for every chunk, each one on its own thread                              *
+ * PRE : f must be safe to call concurrently for different chunks           *
+ * POST: f has been called for all chunks, chunk k covers                   *
+ *       [k*n/chunks, (k+1)*n/chunks) so the split is deterministic         */
+template <typename Function>
+void parallel_chunks(const std::size_t n, unsigned chunks, Function f)
+{
+  chunks = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(chunks, n)));
+
+  // no need to spawn a thread for a single chunk
+  if (chunks == 1) {
+    f(std::size_t(0), n, 0u);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (unsigned k = 1; k < chunks; ++k) {
+    const std::size_t begin = k*n/chunks,
+                      end = (k + 1)*n/chunks;
+    workers.emplace_back([=, &f]() { f(begin, end, k); });
+  }
+  // the calling thread takes the first chunk
+  f(std::size_t(0), n/chunks, 0u);
+
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+} // end namespace mgl
+
+#endif
@@ -2,7 +2,19 @@
 #define MGL_PLOT_H
 
 #include <iostream>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <type_traits>
 #include <mgl2/mgl.h>
+#include "MglData.hpp"
+#include "MglRender.hpp"
+#include "MglScene.hpp"
+#include "MglClip.hpp"
+#include "MglSimplify.hpp"
+#include "MglHistogram.hpp"
 
 namespace mgl {
 
@@ -12,10 +24,26 @@ public:
   MglPlot(const std::string& style)
     : style_{style}
     , legend_{""}
+    , dirty_(true)
+    , cached_(false)
+    , extent_{{ empty_range(), empty_range(), empty_range() }}
+    , extentChanged_(false)
   {}
-  virtual void plot(mglGraph* gr) = 0;
+  virtual ~MglPlot() {}
+  virtual void plot(mglGraph* gr, MglRenderContext& ctx) = 0;
   virtual bool is_3d() = 0;
 
+  /* add the legend entry of this plot to gr                              *
+   * NOTE: kept apart from plot() so the legend can be drawn once on the  *
+   *       final canvas when the plots are rendered on separate layers    */
+  virtual void legend(mglGraph* gr) {
+    // only add the legend-entry if there is one, otherwise we might end up
+    // with a legend-entry containing the line style but no description
+    if (legend_.size() > 0) { 
+      gr->AddLegend(legend_.c_str(), style_.c_str());
+    }
+  }
+
   MglPlot& label(const std::string& l) {
     legend_ = l;
     return *this;
@@ -23,38 +51,230 @@ public:
 
   MglPlot& style(const std::string& s) {
     style_ = s;
+    dirty_ = true;
     return *this;
   }
 
+  const std::string& get_style() const {
+    return style_;
+  }
+
   MglPlot& width(int w) {
     w = w < 0 ? 0 : (w > 9 ? 9 : w);
     if(style_.size() == 3)
       style_[3] = char( '0' + w );
     else
       style_ += {char( '0' + w )};
+    dirty_ = true;
+    return *this;
+  }
+
+  /* has the plot changed since it was last drawn? The label is not       *
+   * tracked, the legend is drawn anew on every save                      */
+  bool is_dirty() const {
+    return dirty_;
+  }
+
+  void set_dirty(const bool dirty) {
+    dirty_ = dirty;
+  }
+
+  /* is the plot part of the cached background of its figure? */
+  bool is_cached() const {
+    return cached_;
+  }
+
+  void set_cached(const bool cached) {
+    cached_ = cached;
+  }
+
+  /* extent of the data on axis 0 (x), 1 (y) or 2 (z), empty if the plot *
+   * has no data on the axis                                              */
+  const MglRange& extent(const int axis) const {
+    return extent_[axis];
+  }
+
+  /* has the extent changed since the figure last looked at it? */
+  bool extent_changed() const {
+    return extentChanged_;
+  }
+
+  void set_extent_changed(const bool changed) {
+    extentChanged_ = changed;
+  }
+
+  /* bytes of the data held by the plot, data linked from the caller are not counted */
+  virtual std::size_t memory() const = 0;
+
+  /* number of points plot() hands to MathGL at most, for the memory estimate of a save */
+  virtual std::size_t points() const = 0;
+
+  /* reduce the data to what can be seen on the device, for the memory budget of the figure *
+   * PRE : mx, my map x and y to the pixels of the plot region                              *
+   * POST: returns true if the plot holds less data now. The graphic does not change at the *
+   *       current ranges and size, zooming in later shows the reduced data                 */
+  virtual bool decimate(const MglAxisMap&, const MglAxisMap&) {
+    return false;
+  }
+
+  /* the plot as density plot, for the memory budget of the figure              *
+   * PRE : bins > 0                                                             *
+   * POST: returns a new MglDensity of bins x bins cells on the extent of the   *
+   *       plot, nullptr if the plot is no scatter plot. This plot is unchanged */
+  virtual MglPlot* rasterize(const int) const {
+    return nullptr;
+  }
+
+  /* prepare the data for pretransformed log axes, see Figure::setLogTransform *
+   * PRE : -                                                                   *
+   * POST: returns false if the plot can't be drawn on pretransformed axes.    *
+   *       Otherwise plot() may draw log10 of x (y) if logx (logy), for        *
+   *       ctx.logData_ set accordingly                                        */
+  virtual bool log_transform(const bool, const bool) {
+    return false;
+  }
+
+  /* number of points left out by the last log_transform(), as they are not positive */
+  virtual std::size_t dropped() const {
+    return 0;
+  }
+
+  /* type tags of the plot classes in scene files, see Figure::serialize */
+  enum Type { Plot2d = 1, Plot3d, FPlot, Spy, BarPlot, Density, FieldPlot };
+
+  /* write the plot to a scene: type, style, label and data, see read_plot() */
+  void serialize(MglSceneWriter& out) const {
+    out.u32(type());
+    out.str(style_);
+    out.str(legend_);
+    write(out);
+  }
+
+  /* replace the data of the plot                                          *
+   * PRE : x, y (and z) have the same size                                 *
+   * POST: the plot shows the new data, its figure adapts the auto ranges  *
+   *       at the next save. Plots that are not made of x-y(-z) data, e.g. *
+   *       fplot, spy, density and field plots, keep their data           */
+  template <typename xVector, typename yVector>
+  MglPlot& set_data(const xVector& x, const yVector& y) {
+    return set_data(make_mgldata(x), make_mgldata(y));
+  }
+
+  template <typename xVector, typename yVector, typename zVector>
+  MglPlot& set_data(const xVector& x, const yVector& y, const zVector& z) {
+    return set_data(make_mgldata(x), make_mgldata(y), make_mgldata(z));
+  }
+
+  MglPlot& set_data(const mglData& xd, const mglData& yd) {
+    if (xd.GetNx() != yd.GetNx()) {
+      std::cerr << "In function MglPlot::set_data(): Vectors must have same sizes!";
+    }
+    else if (!replace(xd, yd, nullptr)) {
+      std::cerr << "In function MglPlot::set_data(): The data of this plot can't be replaced by x-y data!";
+    }
+    else {
+      dirty_ = true;
+      extentChanged_ = true;
+    }
+    return *this;
+  }
+
+  MglPlot& set_data(const mglData& xd, const mglData& yd, const mglData& zd) {
+    if (xd.GetNx() != yd.GetNx() || yd.GetNx() != zd.GetNx()) {
+      std::cerr << "In function MglPlot::set_data(): Vectors must have same sizes!";
+    }
+    else if (!replace(xd, yd, &zd)) {
+      std::cerr << "In function MglPlot::set_data(): The data of this plot can't be replaced by x-y-z data!";
+    }
+    else {
+      dirty_ = true;
+      extentChanged_ = true;
+    }
     return *this;
   }
 
 protected:
+  /* take new data, zd is nullptr for x-y data                        *
+   * POST: returns false if the plot can't take data of this kind,    *
+   *       otherwise the data and extent_ are replaced                */
+  virtual bool replace(const mglData&, const mglData&, const mglData*) {
+    return false;
+  }
+
+  virtual Type type() const = 0;
+
+  /* write the data of the plot, in the order read_plot() reads them */
+  virtual void write(MglSceneWriter& out) const = 0;
+
   std::string style_;
   std::string legend_;
+  bool dirty_; // changed since it was last drawn?
+  bool cached_; // rasterized on the cached background of the figure?
+  std::array<MglRange, 3> extent_; // x, y and z extent of the data, for the auto ranges
+  bool extentChanged_; // data replaced since the figure last updated its ranges?
 };
 
 class MglPlot2d : public MglPlot {
 public:
 
-  MglPlot2d(const mglData& xd, const mglData& yd, const std::string& style)
+  // the data are moved into the plot, see swap_data()
+  MglPlot2d(mglData&& xd, mglData&& yd, const std::string& style)
     : MglPlot(style)
-    , xd_(xd)
-    , yd_(yd)
-  {}
+    , sorted_(false)
+    , logSorted_(false)
+    , logCached_{{false, false}}
+    , dropped_(0)
+    , droppedAxes_{{false, false}}
+  {
+    swap_data(xd_, xd);
+    swap_data(yd_, yd);
+    split();
+  }
 
-  void plot(mglGraph* gr) {
-    gr->Plot(xd_, yd_, style_.c_str());
-    // only add the legend-entry if there is one, otherwise we might end up
-    // with a legend-entry containing the line style but no description
-    if (legend_.size() > 0) { 
-      gr->AddLegend(legend_.c_str(), style_.c_str());
+  void plot(mglGraph* gr, MglRenderContext& ctx) {
+    // on pretransformed log axes the cached log10 data are drawn, see log_transform()
+    const mglData& xd = ctx.logData_[0] ? lxd_ : xd_;
+    const mglData& yd = ctx.logData_[1] ? lyd_ : yd_;
+    const bool sorted = ctx.logData_[0] ? logSorted_ : sorted_;
+
+    const bool simplify = ctx.lineTolerance_ > 0 && !has_markers(style_);
+    if (!ctx.clip_ && !simplify) {
+      gr->Plot(xd, yd, style_.c_str());
+      return;
+    }
+
+    // only hand the visible part to MathGL
+    const double* data[2] = { xd.a, yd.a };
+    long n = xd.GetNx();
+    if (ctx.clip_ && sorted) {
+      long begin = 0;
+      n = clip_sorted(xd.a, n, ctx.ranges_[0], ctx.ranges_[1], begin);
+      data[0] += begin;
+      data[1] += begin;
+    }
+    else if (ctx.clip_) {
+      double* out[2] = { ctx.scratch(n), ctx.scratch(n) };
+      const double lo[2] = { ctx.ranges_[0], ctx.ranges_[2] },
+                   hi[2] = { ctx.ranges_[1], ctx.ranges_[3] };
+      n = clip_polyline(data, 2, n, lo, hi, out, ctx.mask(n));
+      std::copy(out, out + 2, data);
+    }
+
+    // vector output stores every point, drop those that do not change the
+    // line on the device
+    if (simplify && n > 2) {
+      const MglAxisMap mx(ctx.ranges_[0], ctx.ranges_[1], ctx.width_, ctx.logx_),
+                       my(ctx.ranges_[2], ctx.ranges_[3], ctx.height_, ctx.logy_);
+      double* out[2] = { ctx.scratch(n), ctx.scratch(n) };
+      n = simplify_polyline(data[0], data[1], n, mx, my, ctx.lineTolerance_, out[0], out[1]);
+      std::copy(out, out + 2, data);
+    }
+
+    if (n > 0) {
+      mglData xc, yc;
+      xc.Link(const_cast<double*>(data[0]), n);
+      yc.Link(const_cast<double*>(data[1]), n);
+      gr->Plot(xc, yc, style_.c_str());
     }
   }
 
@@ -62,27 +282,163 @@ public:
     return false;
   }
 
+  std::size_t memory() const {
+    return data_bytes(xd_) + data_bytes(yd_) + data_bytes(lxd_) + data_bytes(lyd_);
+  }
+
+  std::size_t points() const {
+    return std::size_t(xd_.GetNx());
+  }
+
+  /* the log10 data are computed once and kept until the data change */
+  bool log_transform(const bool logx, const bool logy) {
+    const long n = xd_.GetNx();
+    const std::array<bool, 2> axes = {{ logx, logy }};
+    if (axes == droppedAxes_ && (!logx || logCached_[0]) && (!logy || logCached_[1])) {
+      return true;
+    }
+    if (logx && !logCached_[0]) {
+      lxd_.Create(n);
+      log10_positive(xd_.a, n, lxd_.a);
+      logSorted_ = is_sorted_gaps(lxd_);
+      logCached_[0] = true;
+    }
+    if (logy && !logCached_[1]) {
+      lyd_.Create(n);
+      log10_positive(yd_.a, n, lyd_.a);
+      logCached_[1] = true;
+    }
+    dropped_ = 0;
+    for (long i = 0; i < n; ++i) {
+      dropped_ += (logx && xd_.a[i] <= 0) || (logy && yd_.a[i] <= 0);
+    }
+    droppedAxes_ = axes;
+    return true;
+  }
+
+  std::size_t dropped() const {
+    return dropped_;
+  }
+
+  /* lines keep at most 4 points per pixel column if x is sorted, otherwise *
+   * they are simplified to half a pixel. Markers are drawn for every point */
+  bool decimate(const MglAxisMap& mx, const MglAxisMap& my) {
+    const long n = xd_.GetNx();
+    if (n < 4 || has_markers(style_)) {
+      return false;
+    }
+    std::vector<double> xo(n), yo(n);
+    const long m = sorted_ ? decimate_columns(xd_.a, yd_.a, n, mx, my, xo.data(), yo.data())
+                           : simplify_polyline(xd_.a, yd_.a, n, mx, my, 0.5, xo.data(), yo.data());
+    if (m >= n) {
+      return false;
+    }
+    xd_.Set(xo.data(), m);
+    yd_.Set(yo.data(), m);
+    drop_log();
+    extent_[0] = data_range(xd_);
+    extent_[1] = data_range(yd_);
+    dirty_ = true;
+    extentChanged_ = true;
+    return true;
+  }
+
+  MglPlot* rasterize(const int bins) const;
+
+protected:
+  bool replace(const mglData& xd, const mglData& yd, const mglData* zd) {
+    if (zd) {
+      return false;
+    }
+    xd_ = xd;
+    yd_ = yd;
+    split();
+    drop_log();
+    return true;
+  }
+
+  Type type() const {
+    return Plot2d;
+  }
+
+  void write(MglSceneWriter& out) const {
+    out.data(xd_);
+    out.data(yd_);
+  }
+
 private:
+  /* take new data as one series: gaps are merged so every segment is drawn *
+   * by this plot, see split_gaps(), and left out of the extent             */
+  void split() {
+    mglData* data[2] = { &xd_, &yd_ };
+    split_gaps(data, 2);
+    sorted_ = is_sorted_gaps(xd_);
+    extent_[0] = data_range(xd_);
+    extent_[1] = data_range(yd_);
+  }
+
+  /* forget the log10 data, after the data changed */
+  void drop_log() {
+    lxd_ = mglData();
+    lyd_ = mglData();
+    logCached_ = {{false, false}};
+    dropped_ = 0;
+    droppedAxes_ = {{false, false}};
+  }
+
   mglData xd_;
   mglData yd_;
+  bool sorted_; // x data sorted (apart from gaps)? then the visible window is found by binary search
+  mglData lxd_, lyd_; // log10 of xd_ and yd_, NaN for values that are not positive
+  bool logSorted_; // lxd_ sorted and finite?
+  std::array<bool, 2> logCached_; // are lxd_ and lyd_ computed?
+  std::size_t dropped_; // points left out by the last log_transform()
+  std::array<bool, 2> droppedAxes_; // log scaled axes dropped_ has been counted for
 };
 
 class MglPlot3d : public MglPlot {
 public:
 
-  MglPlot3d(const mglData& xd, const mglData& yd, const mglData& zd, const std::string& style)
+  // the data are moved into the plot, see swap_data()
+  MglPlot3d(mglData&& xd, mglData&& yd, mglData&& zd, const std::string& style)
     : MglPlot(style)
-    , xd_(xd)
-    , yd_(yd)
-    , zd_(zd)
-  {}
+  {
+    swap_data(xd_, xd);
+    swap_data(yd_, yd);
+    swap_data(zd_, zd);
+    split();
+  }
 
-  void plot(mglGraph* gr) {
-    gr->Plot(xd_, yd_, zd_, style_.c_str());
-    // only add the legend-entry if there is one, otherwise we might end up
-    // with a legend-entry containing the line style but no description
-    if (legend_.size() > 0) { 
-      gr->AddLegend(legend_.c_str(), style_.c_str());
+  void plot(mglGraph* gr, MglRenderContext& ctx) {
+    const double* data[3] = { xd_.a, yd_.a, zd_.a };
+    long n = xd_.GetNx();
+
+    // only hand the visible part to MathGL
+    if (ctx.clip_) {
+      double* out[3] = { ctx.scratch(n), ctx.scratch(n), ctx.scratch(n) };
+      const double lo[3] = { ctx.ranges_[0], ctx.ranges_[2], ctx.zranges_[0] },
+                   hi[3] = { ctx.ranges_[1], ctx.ranges_[3], ctx.zranges_[1] };
+      n = clip_polyline(data, 3, n, lo, hi, out, ctx.mask(n));
+      std::copy(out, out + 3, data);
+    }
+
+    // drop the points that are less than the tolerance apart on the screen,
+    // markers have to be drawn for every point
+    if (ctx.tolerance_ > 0 && n > 1024 && !has_markers(style_)) {
+      const std::array<double, 6> ranges = { ctx.ranges_[0], ctx.ranges_[1], ctx.ranges_[2],
+                                             ctx.ranges_[3], ctx.zranges_[0], ctx.zranges_[1] };
+      const MglProjection project(ranges, ctx.view_[0], ctx.view_[1], std::max(ctx.width_, ctx.height_));
+      double* out[3] = { ctx.scratch(n), ctx.scratch(n), ctx.scratch(n) };
+      n = simplify_projected(data, n, project, ctx.tolerance_, out);
+      std::copy(out, out + 3, data);
+    }
+
+    if (n > 0) {
+      mglData xc, yc, zc;
+      xc.Link(const_cast<double*>(data[0]), n);
+      yc.Link(const_cast<double*>(data[1]), n);
+      zc.Link(const_cast<double*>(data[2]), n);
+      gr->Plot(xc, yc, zc, style_.c_str());
     }
   }
 
@@ -90,7 +446,44 @@ public:
     return true;
   }
 
+  std::size_t memory() const {
+    return data_bytes(xd_) + data_bytes(yd_) + data_bytes(zd_);
+  }
+
+  std::size_t points() const {
+    return std::size_t(xd_.GetNx());
+  }
+
+protected:
+  bool replace(const mglData& xd, const mglData& yd, const mglData* zd) {
+    if (!zd) {
+      return false;
+    }
+    xd_ = xd;
+    yd_ = yd;
+    zd_ = *zd;
+    split();
+    return true;
+  }
+
+  Type type() const {
+    return Plot3d;
+  }
+
+  void write(MglSceneWriter& out) const {
+    out.data(xd_);
+    out.data(yd_);
+    out.data(zd_);
+  }
+
 private:
+  /* see MglPlot2d::split() */
+  void split() {
+    mglData* data[3] = { &xd_, &yd_, &zd_ };
+    split_gaps(data, 3);
+    extent_ = {{ data_range(xd_), data_range(yd_), data_range(zd_) }};
+  }
+
   mglData xd_;
   mglData yd_;
   mglData zd_;
@@ -104,19 +497,32 @@ public:
     , fplot_str_(fplot_str)
   {}
 
-  void plot(mglGraph* gr) {
+  void plot(mglGraph* gr, MglRenderContext&) {
     gr->FPlot(fplot_str_.c_str(), style_.c_str());
-    // only add the legend-entry if there is one, otherwise we might end up
-    // with a legend-entry containing the line style but no description
-    if (legend_.size() > 0) { 
-      gr->AddLegend(legend_.c_str(), style_.c_str());
-    }
   }
 
   bool is_3d() {
     return false;
   }
 
+  std::size_t memory() const {
+    return fplot_str_.size();
+  }
+
+  // MathGL evaluates the function at 100 points and refines where it is curved
+  std::size_t points() const {
+    return 1000;
+  }
+
+protected:
+  Type type() const {
+    return FPlot;
+  }
+
+  void write(MglSceneWriter& out) const {
+    out.str(fplot_str_);
+  }
+
 private:
   std::string fplot_str_;
 };
@@ -124,20 +530,75 @@ private:
 class MglSpy : public MglPlot {
 public:
 
-  MglSpy(const mglData& xd, const mglData& yd, const std::string& style) 
+  /* xd, yd: column and row indices (1-based) of the nonzero entries of a rows x cols matrix */
+  MglSpy(const mglData& xd, const mglData& yd, const long rows, const long cols, const std::string& style) 
     : MglPlot(style)
     , xd_(xd)
     , yd_(yd)
-  {}
+  {
+    extent_[0] = span_range(0, cols + 1);
+    extent_[1] = span_range(0, rows + 1);
+  }
 
   bool is_3d() {
     return false;
   }
 
-  void plot(mglGraph* gr) {
-    mglData zd(xd_);
-    zd.Modify("0");
-    gr->Dots(xd_, yd_, zd, style_.c_str());
+  void plot(mglGraph* gr, MglRenderContext& ctx) {
+    // the z data are all zero, they live in the scratch memory of the render pass
+    if (!ctx.clip_) {
+      const long n = xd_.GetNx();
+      double* z = ctx.scratch(n);
+      std::fill(z, z + n, 0.);
+      mglData zd;
+      zd.Link(z, n);
+      gr->Dots(xd_, yd_, zd, style_.c_str());
+      return;
+    }
+
+    // only hand the visible entries to MathGL
+    const long n = xd_.GetNx();
+    const double* in[2] = { xd_.a, yd_.a };
+    double* out[2] = { ctx.scratch(n), ctx.scratch(n) };
+    const double lo[2] = { ctx.ranges_[0], ctx.ranges_[2] },
+                 hi[2] = { ctx.ranges_[1], ctx.ranges_[3] };
+    const long m = clip_points(in, 2, n, lo, hi, out, ctx.mask(n));
+    if (m > 0) {
+      double* z = ctx.scratch(m);
+      std::fill(z, z + m, 0.);
+      mglData xc, yc, zc;
+      xc.Link(out[0], m);
+      yc.Link(out[1], m);
+      zc.Link(z, m);
+      gr->Dots(xc, yc, zc, style_.c_str());
+    }
+  }
+
+  // spy plots have no legend entry
+  void legend(mglGraph*) {}
+
+  std::size_t memory() const {
+    return data_bytes(xd_) + data_bytes(yd_);
+  }
+
+  std::size_t points() const {
+    return std::size_t(xd_.GetNx());
+  }
+
+  // the entries are dots, so a spy plot is a scatter plot
+  MglPlot* rasterize(const int bins) const;
+
+protected:
+  Type type() const {
+    return Spy;
+  }
+
+  void write(MglSceneWriter& out) const {
+    // the size of the matrix, see the constructor
+    out.u64(std::uint64_t(extent_[1].max - 1));
+    out.u64(std::uint64_t(extent_[0].max - 1));
+    out.data(xd_);
+    out.data(yd_);
   }
 
 private:
@@ -147,29 +608,443 @@ private:
 
 class MglBarPlot : public MglPlot {
 public:
-  MglBarPlot(const mglData& xd, const mglData& yd, const std::string& style) 
+  // the data are moved into the plot, see swap_data()
+  MglBarPlot(mglData&& xd, mglData&& yd, const std::string& style)
     : MglPlot(style)
-    , xd_(xd)
-    , yd_(yd)
-  {}
+    , sorted_(is_sorted_finite(xd))
+  {
+    swap_data(xd_, xd);
+    swap_data(yd_, yd);
+    extent_[0] = data_range(xd_);
+    extent_[1] = data_range(yd_);
+  }
 
   bool is_3d() {
     return false;
   }
 
-  void plot(mglGraph* gr) {
-    gr->Bars(xd_, yd_, style_.c_str());
-    // only add the legend-entry if there is one, otherwise we might end up
-    // with a legend-entry containing the line style but no description
-    if (legend_.size() > 0) { 
-      gr->AddLegend(legend_.c_str(), style_.c_str());
+  void plot(mglGraph* gr, MglRenderContext& ctx) {
+    if (!ctx.clip_) {
+      gr->Bars(xd_, yd_, style_.c_str());
+      return;
+    }
+
+    // bars are clipped in x only, their height is clipped by MathGL.
+    // for sorted x the neighbours beyond the boundaries are kept, as MathGL uses them for the bar width
+    mglData xc, yc;
+    if (sorted_) {
+      long begin = 0;
+      const long n = clip_sorted(xd_.a, xd_.GetNx(), ctx.ranges_[0], ctx.ranges_[1], begin);
+      xc.Link(xd_.a + begin, n);
+      yc.Link(yd_.a + begin, n);
+    }
+    else {
+      const long n = xd_.GetNx();
+      const double inf = std::numeric_limits<double>::infinity();
+      const double* in[2] = { xd_.a, yd_.a };
+      double* out[2] = { ctx.scratch(n), ctx.scratch(n) };
+      const double lo[2] = { ctx.ranges_[0], -inf },
+                   hi[2] = { ctx.ranges_[1], inf };
+      const long m = clip_points(in, 2, n, lo, hi, out, ctx.mask(n));
+      xc.Link(out[0], m);
+      yc.Link(out[1], m);
+    }
+    if (xc.GetNx() > 0) {
+      gr->Bars(xc, yc, style_.c_str());
+    }
+  }
+
+  std::size_t memory() const {
+    return data_bytes(xd_) + data_bytes(yd_);
+  }
+
+  // every bar is a quadrangle
+  std::size_t points() const {
+    return 4*std::size_t(xd_.GetNx());
+  }
+
+protected:
+  bool replace(const mglData& xd, const mglData& yd, const mglData* zd) {
+    if (zd) {
+      return false;
     }
+    xd_ = xd;
+    yd_ = yd;
+    sorted_ = is_sorted_finite(xd_);
+    extent_[0] = data_range(xd_);
+    extent_[1] = data_range(yd_);
+    return true;
+  }
+
+  Type type() const {
+    return BarPlot;
+  }
+
+  void write(MglSceneWriter& out) const {
+    out.data(xd_);
+    out.data(yd_);
   }
 
 private:
   mglData xd_;
   mglData yd_;
+  bool sorted_; // x data sorted? then the visible window is found by binary search
 };
 
+class MglDensity : public MglPlot {
+public:
+  /* counts: nx x ny grid of point counts on box = {xMin, xMax, yMin, yMax} */
+  MglDensity(const mglData& counts, const std::array<double, 4>& box, const std::string& style)
+    : MglPlot(style)
+    , xd_(counts.GetNx())
+    , yd_(counts.GetNy())
+    , cd_(counts)
+    , maxCount_(0)
+  {
+    const long nx = counts.GetNx(), ny = counts.GetNy();
+    // cell centers
+    for (long i = 0; i < nx; ++i) {
+      xd_.a[i] = box[0] + (i + 0.5)*(box[1] - box[0])/nx;
+    }
+    for (long j = 0; j < ny; ++j) {
+      yd_.a[j] = box[2] + (j + 0.5)*(box[3] - box[2])/ny;
+    }
+    extent_[0] = span_range(box[0], box[1]);
+    extent_[1] = span_range(box[2], box[3]);
+    // empty cells are not drawn
+    for (long c = 0; c < nx*ny; ++c) {
+      maxCount_ = std::max(maxCount_, cd_.a[c]);
+      if (cd_.a[c] == 0) {
+        cd_.a[c] = std::numeric_limits<double>::quiet_NaN();
+      }
+    }
+  }
+
+  bool is_3d() {
+    return false;
+  }
+
+  void plot(mglGraph* gr, MglRenderContext&) {
+    // the data are binned already, only the colors have to be scaled to the counts
+    gr->SetRange('c', 0, std::max(1., maxCount_));
+    gr->Dens(xd_, yd_, cd_, style_.c_str());
+  }
+
+  std::size_t memory() const {
+    return data_bytes(xd_) + data_bytes(yd_) + data_bytes(cd_);
+  }
+
+  std::size_t points() const {
+    return std::size_t(cd_.GetNx())*cd_.GetNy();
+  }
+
+protected:
+  Type type() const {
+    return Density;
+  }
+
+  void write(MglSceneWriter& out) const {
+    // the box is the extent, empty cells are NaN and stay empty when read
+    out.f64(extent_[0].min);
+    out.f64(extent_[0].max);
+    out.f64(extent_[1].min);
+    out.f64(extent_[1].max);
+    out.data(cd_);
+  }
+
+private:
+  mglData xd_; // x coordinates of the cell centers
+  mglData yd_; // y coordinates of the cell centers
+  mglData cd_; // counts, NaN for empty cells
+  double maxCount_; // largest count
+};
+
+/* density plot of the points (xd[i], yd[i]) on the box of extent, see MglPlot::rasterize */
+inline MglDensity* make_density(const mglData& xd, const mglData& yd, const std::array<MglRange, 3>& extent, const int bins)
+{
+  std::array<double, 4> box = {{ extent[0].min, extent[0].max, extent[1].min, extent[1].max }};
+  if (box[0] > box[1] || box[2] > box[3]) {
+    box = {{0, 1, 0, 1}}; // no finite data
+  }
+  // avoid empty cells if all points have the same x or y
+  for (int d = 0; d < 4; d += 2) {
+    if (box[d] == box[d + 1]) {
+      box[d] -= 0.5;
+      box[d + 1] += 0.5;
+    }
+  }
+  mglData counts(bins, bins);
+  bin2d(xd.a, yd.a, std::size_t(xd.GetNx()), box, bins, bins, counts.a);
+  return new MglDensity(counts, box, "BbcyrR");
+}
+
+/* only markers without a line are a scatter plot */
+inline MglPlot* MglPlot2d::rasterize(const int bins) const
+{
+  if (!has_markers(style_) || draws_line(style_)) {
+    return nullptr;
+  }
+  MglPlot* density = make_density(xd_, yd_, extent_, bins);
+  density->label(legend_);
+  return density;
+}
+
+inline MglPlot* MglSpy::rasterize(const int bins) const
+{
+  return make_density(xd_, yd_, extent_, bins);
+}
+
+class MglFieldPlot : public MglPlot {
+public:
+  enum Kind { Surf, Heatmap, Contour };
+
+  /* zd: field with nx columns and ny rows, zd.a[j + nx*i] is the value in row i, column j */
+  MglFieldPlot(const mglData& zd, const Kind kind, const std::string& style)
+    : MglPlot(style)
+    , zd_(zd)
+    , kind_(kind)
+  {
+    find_extent();
+  }
+
+  /* view on rows x cols values with row i at data + i*rowStride, not copied *
+   * PRE : rowStride == cols, data outlives the rendering                    */
+  MglFieldPlot(const double* data, const long rows, const long cols, const Kind kind, const std::string& style)
+    : MglPlot(style)
+    , kind_(kind)
+  {
+    // MathGL only reads the data, linking needs a non-const pointer though
+    zd_.Link(const_cast<double*>(data), cols, rows);
+    find_extent();
+  }
+
+  bool is_3d() {
+    return kind_ == Surf;
+  }
+
+  /* contour levels, by default 7 levels evenly spaced between the extreme values */
+  void levels(const std::vector<double>& v) {
+    levels_ = v;
+  }
+
+  /* n contour levels evenly spaced between the extreme values */
+  void levels(const int n) {
+    levels_.clear();
+    for (int k = 1; k <= n; ++k) {
+      levels_.push_back(zMin_ + k*(zMax_ - zMin_)/(n + 1));
+    }
+  }
+
+  double min() const {
+    return zMin_;
+  }
+
+  std::size_t memory() const {
+    return data_bytes(zd_) + levels_.size()*sizeof(double);
+  }
+
+  // fields finer than the plot region are averaged before they are drawn, see plot()
+  std::size_t points() const {
+    return std::size_t(zd_.GetNx())*zd_.GetNy();
+  }
+
+  double max() const {
+    return zMax_;
+  }
+
+  void plot(mglGraph* gr, MglRenderContext& ctx) {
+    // downsample to the pixel grid of the plot, finer grids are not visible anyway
+    const long nx = zd_.GetNx(), ny = zd_.GetNy();
+    const long bx = (ctx.width_ > 0 && nx > ctx.width_) ? (nx + ctx.width_ - 1)/ctx.width_ : 1,
+               by = (ctx.height_ > 0 && ny > ctx.height_) ? (ny + ctx.height_ - 1)/ctx.height_ : 1;
+    const long mx = (nx + bx - 1)/bx, my = (ny + by - 1)/by;
+
+    mglData x, y, z;
+    double* xs = ctx.scratch(mx);
+    double* ys = ctx.scratch(my);
+    // coordinates are 1-based indices, at the block centers if downsampled
+    for (long j = 0; j < mx; ++j) {
+      xs[j] = 1 + j*bx + 0.5*(std::min(bx, nx - j*bx) - 1);
+    }
+    for (long i = 0; i < my; ++i) {
+      ys[i] = 1 + i*by + 0.5*(std::min(by, ny - i*by) - 1);
+    }
+    x.Link(xs, mx);
+    y.Link(ys, my);
+    if (bx == 1 && by == 1) {
+      z.Link(zd_.a, nx, ny);
+    }
+    else {
+      double* zs = ctx.scratch(mx*my);
+      block_average(zs, bx, by, mx, my);
+      z.Link(zs, mx, my);
+    }
+
+    gr->SetRange('c', zMin_, zMax_ > zMin_ ? zMax_ : zMin_ + 1);
+    switch (kind_) {
+      case Surf:
+        gr->Surf(x, y, z, style_.c_str());
+        break;
+      case Heatmap:
+        gr->Dens(x, y, z, style_.c_str());
+        break;
+      case Contour: {
+        std::vector<double> v = levels_;
+        if (v.empty()) {
+          for (int k = 1; k <= 7; ++k) {
+            v.push_back(zMin_ + k*(zMax_ - zMin_)/8);
+          }
+        }
+        mglData vd;
+        vd.Link(v.data(), long(v.size()));
+        gr->Cont(vd, x, y, z, style_.c_str());
+        break;
+      }
+    }
+  }
+
+protected:
+  Type type() const {
+    return FieldPlot;
+  }
+
+  void write(MglSceneWriter& out) const {
+    out.u32(std::uint32_t(kind_));
+    out.data(zd_);
+    out.array(levels_.data(), levels_.size());
+  }
+
+private:
+  /* range of the finite values, the field spans x = [1, cols] and y = [1, rows] */
+  void find_extent() {
+    const MglRange z = data_range(zd_.a, long(zd_.GetNx())*zd_.GetNy());
+    zMin_ = z.empty() ? 0 : z.min;
+    zMax_ = z.empty() ? 0 : z.max;
+
+    extent_[0] = span_range(1, std::max(zd_.GetNx(), 2L));
+    extent_[1] = span_range(1, std::max(zd_.GetNy(), 2L));
+    // only surfaces have a z axis
+    if (kind_ == Surf) {
+      extent_[2] = z.empty() ? span_range(0, 0) : z;
+    }
+  }
+
+  /* average of the finite values in blocks of bx x by values, NaN for blocks without any */
+  void block_average(double* out, const long bx, const long by, const long mx, const long my) const {
+    const long nx = zd_.GetNx(), ny = zd_.GetNy();
+    for (long I = 0; I < my; ++I) {
+      for (long J = 0; J < mx; ++J) {
+        double sum = 0;
+        long count = 0;
+        for (long i = I*by; i < std::min(ny, (I + 1)*by); ++i) {
+          const double* row = zd_.a + nx*i;
+          for (long j = J*bx; j < std::min(nx, (J + 1)*bx); ++j) {
+            if (std::isfinite(row[j])) {
+              sum += row[j];
+              ++count;
+            }
+          }
+        }
+        out[J + mx*I] = count > 0 ? sum/count : std::numeric_limits<double>::quiet_NaN();
+      }
+    }
+  }
+
+  mglData zd_; // the field, owned or a view
+  Kind kind_; // how the field is drawn
+  std::vector<double> levels_; // contour levels
+  double zMin_, zMax_; // range of the finite values
+};
+
+#if FIG_HAS_EIGEN
+/* field plot of an Eigen matrix                                             *
+ * PRE : -                                                                   *
+ * POST: returns a new plot. If link is true, row-major matrices of mreal    *
+ *       with contiguous rows (e.g. a Matrix or Map with RowMajor) are not   *
+ *       copied, like contiguous raw fields, and must not be changed or      *
+ *       freed until the figure is saved. Other matrices are copied          */
+template <typename Derived>
+typename std::enable_if<(Derived::Flags & Eigen::DirectAccessBit) && (Derived::Flags & Eigen::RowMajorBit)
+                        && std::is_same<typename Derived::Scalar, mreal>::value, MglFieldPlot*>::type
+make_field_plot(const Eigen::MatrixBase<Derived>& Z, const MglFieldPlot::Kind kind, const std::string& style, const bool link)
+{
+  if (link && Z.innerStride() == 1 && Z.outerStride() == Z.cols()) {
+    return new MglFieldPlot(Z.derived().data(), Z.rows(), Z.cols(), kind, style);
+  }
+  return new MglFieldPlot(make_mgldata_field(Z), kind, style);
+}
+
+template <typename Derived>
+typename std::enable_if<!((Derived::Flags & Eigen::DirectAccessBit) && (Derived::Flags & Eigen::RowMajorBit)
+                          && std::is_same<typename Derived::Scalar, mreal>::value), MglFieldPlot*>::type
+make_field_plot(const Eigen::MatrixBase<Derived>& Z, const MglFieldPlot::Kind kind, const std::string& style, const bool)
+{
+  return new MglFieldPlot(make_mgldata_field(Z), kind, style);
+}
+#endif
+
+/* read a plot written by MglPlot::serialize                                *
+ * PRE : -                                                                  *
+ * POST: returns the plot, allocated with new. nullptr if the type is       *
+ *       unknown, in.good() is false if the data are damaged                */
+inline MglPlot* read_plot(MglSceneReader& in)
+{
+  const std::uint32_t type = in.u32();
+  const std::string style = in.str(),
+                    legend = in.str();
+
+  MglPlot* plot = nullptr;
+  switch (type) {
+    case MglPlot::Plot2d: {
+      mglData xd = in.data(), yd = in.data();
+      plot = new MglPlot2d(std::move(xd), std::move(yd), style);
+      break;
+    }
+    case MglPlot::Plot3d: {
+      mglData xd = in.data(), yd = in.data(), zd = in.data();
+      plot = new MglPlot3d(std::move(xd), std::move(yd), std::move(zd), style);
+      break;
+    }
+    case MglPlot::FPlot: {
+      plot = new MglFPlot(in.str(), style);
+      break;
+    }
+    case MglPlot::Spy: {
+      const long rows = long(in.u64()), cols = long(in.u64());
+      const mglData xd = in.data(), yd = in.data();
+      plot = new MglSpy(xd, yd, rows, cols, style);
+      break;
+    }
+    case MglPlot::BarPlot: {
+      mglData xd = in.data(), yd = in.data();
+      plot = new MglBarPlot(std::move(xd), std::move(yd), style);
+      break;
+    }
+    case MglPlot::Density: {
+      std::array<double, 4> box;
+      for (auto& b : box) {
+        b = in.f64();
+      }
+      plot = new MglDensity(in.data(), box, style);
+      break;
+    }
+    case MglPlot::FieldPlot: {
+      const std::uint32_t kind = in.u32();
+      if (!in.check(kind <= MglFieldPlot::Contour)) {
+        return nullptr;
+      }
+      MglFieldPlot* field = new MglFieldPlot(in.data(), MglFieldPlot::Kind(kind), style);
+      field->levels(in.array());
+      plot = field;
+      break;
+    }
+    default:
+      in.check(false);
+      return nullptr;
+  }
+  plot->label(legend);
+  return plot;
+}
+
 } // end namespace
 #endif
@@ -0,0 +1,364 @@
+#ifndef MGL_PNG_HPP
+#define MGL_PNG_HPP
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <zlib.h>
+#include "MglParallel.hpp"
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+namespace mgl {
+
+/* PNG 'sub' filter of n bytes of 8 bit RGBA pixels: difference to the pixel on the left */
+inline void png_filter_sub(const unsigned char* row, const std::size_t n, unsigned char* out)
+{
+  std::size_t i = 0;
+  for (; i < 4 && i < n; ++i) {
+    out[i] = row[i];
+  }
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)),
+                  b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(a, b));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = (unsigned char)(row[i] - row[i - 4]);
+  }
+}
+
+/* PNG 'up' filter of n bytes: difference to the byte above */
+inline void png_filter_up(const unsigned char* row, const unsigned char* prior, const std::size_t n, unsigned char* out)
+{
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)),
+                  b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(a, b));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = (unsigned char)(row[i] - prior[i]);
+  }
+}
+
+/* sum of the filtered bytes taken as signed, the usual estimate of how well a filtered row compresses */
+inline std::size_t png_filter_cost(const unsigned char* f, const std::size_t n)
+{
+  std::size_t cost = 0, i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = zero;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(f + i)),
+                  a = _mm_min_epu8(x, _mm_sub_epi8(zero, x)); // |x| of the signed bytes
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(a, zero));
+  }
+  cost = std::size_t(_mm_cvtsi128_si32(sum)) + std::size_t(_mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#endif
+  for (; i < n; ++i) {
+    cost += std::size_t(std::abs(int((signed char)f[i])));
+  }
+  return cost;
+}
+
+/* PNG writer that takes the image row by row                                *
+ * NOTE: rows are collected in batches, which are split in chunks of about   *
+ *       128 KiB that are filtered and deflated in parallel as in pigz. Each *
+ *       chunk is a raw deflate stream primed with the last 32 KiB of the    *
+ *       chunk before and ends at a flush boundary, so the chunks concatenate *
+ *       to one zlib stream that decodes like any other. Only a batch has to  *
+ *       be in memory at a time, whatever the size of the image. Every row    *
+ *       takes the 'sub' or 'up' filter, whichever promises the smaller       *
+ *       output. Pixels are 8 bit RGBA, as returned by mglGraph::GetRGBA      */
+class MglPngWriter {
+public:
+
+  /* destination of the encoded bytes, returns false on failure */
+  typedef std::function<bool(const unsigned char* data, std::size_t n)> Sink;
+
+  /* open 'file' and write the header                                   *
+   * PRE : width, height > 0, level is a zlib compression level         *
+   * POST: good() tells if the file could be opened                     */
+  MglPngWriter(const std::string& file, const int width, const int height,
+               const int level = Z_DEFAULT_COMPRESSION)
+    : out_(std::fopen(file.c_str(), "wb"))
+    , width_(width)
+    , height_(height)
+    , level_(level)
+    , rows_(0)
+    , bytes_(0)
+    , ok_(out_ != nullptr)
+    , started_(false)
+    , adler_(adler32(0L, Z_NULL, 0))
+  {
+    std::FILE* out = out_;
+    sink_ = [out](const unsigned char* data, std::size_t n) { return std::fwrite(data, 1, n, out) == n; };
+    header();
+  }
+
+  /* write the image to 'sink', e.g. to memory                          *
+   * PRE : width, height > 0, level is a zlib compression level         *
+   * POST: the header has been handed to sink                           */
+  MglPngWriter(const Sink& sink, const int width, const int height,
+               const int level = Z_DEFAULT_COMPRESSION)
+    : out_(nullptr)
+    , sink_(sink)
+    , width_(width)
+    , height_(height)
+    , level_(level)
+    , rows_(0)
+    , bytes_(0)
+    , ok_(true)
+    , started_(false)
+    , adler_(adler32(0L, Z_NULL, 0))
+  {
+    header();
+  }
+
+  ~MglPngWriter() {
+    if (out_) {
+      std::fclose(out_);
+    }
+  }
+
+  MglPngWriter(const MglPngWriter&) = delete;
+  MglPngWriter& operator=(const MglPngWriter&) = delete;
+
+  bool good() const {
+    return ok_;
+  }
+
+  /* add rows to the image                                                  *
+   * PRE : rgba holds 'rows' rows of width 8 bit RGBA pixels, top to bottom *
+   * POST: the rows are queued, full batches are compressed and written     */
+  void write_rows(const unsigned char* rgba, const int rows) {
+    const std::size_t stride = 4*std::size_t(width_);
+    const std::size_t batch = std::size_t(chunk_rows())*hardware_threads();
+    for (int r = 0; r < rows && ok_; ++r, rgba += stride) {
+      pending_.insert(pending_.end(), rgba, rgba + stride);
+      ++rows_;
+      if (pending_.size() >= batch*stride) {
+        encode(false);
+      }
+    }
+  }
+
+  /* finish the image                                                         *
+   * PRE : all height rows have been added                                    *
+   * POST: the image is complete, the file is closed. Returns its size in     *
+   *       bytes, 0 if writing failed or rows are missing                     */
+  std::size_t close() {
+    if (rows_ != height_) {
+      ok_ = false;
+    }
+    if (ok_) {
+      encode(true);
+      chunk("IEND", nullptr, 0);
+    }
+    if (out_) {
+      ok_ = (std::fclose(out_) == 0) && ok_;
+      out_ = nullptr;
+    }
+    return ok_ ? bytes_ : 0;
+  }
+
+private:
+
+  /* part of a batch, filtered and compressed by one thread */
+  struct Chunk {
+    std::vector<unsigned char> filtered; // filter type and filtered pixels of its rows
+    std::vector<unsigned char> compressed; // raw deflate data
+    uLong adler; // adler32 of filtered
+    bool ok;
+  };
+
+  /* signature and IHDR */
+  void header() {
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    write(signature, 8);
+
+    unsigned char header[13];
+    put32(header, unsigned(width_));
+    put32(header + 4, unsigned(height_));
+    header[8] = 8; // bit depth
+    header[9] = 6; // RGBA
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering
+    header[12] = 0; // no interlacing
+    chunk("IHDR", header, 13);
+  }
+
+  /* rows of a chunk, about 128 KiB of pixels */
+  int chunk_rows() const {
+    return std::max(1, int((std::size_t(1) << 17)/(4*std::size_t(width_) + 1)));
+  }
+
+  /* compress the pending rows and write them as IDAT chunks                 *
+   * PRE : -                                                                 *
+   * POST: the rows are filtered in parallel, then deflated in parallel and  *
+   *       written in order. If 'last' the zlib stream is finished            */
+  void encode(const bool last) {
+    const std::size_t stride = 4*std::size_t(width_);
+    const int rows = int(pending_.size()/stride), per = chunk_rows();
+    std::vector<Chunk> chunks(std::max(1, (rows + per - 1)/per));
+    const unsigned threads = unsigned(std::min<std::size_t>(hardware_threads(), chunks.size()));
+
+    // the row above the first pending row, zero for the first row of the image
+    if (prior_.empty()) {
+      prior_.assign(stride, 0);
+    }
+    parallel_chunks(chunks.size(), threads, [&](std::size_t begin, std::size_t end, unsigned) {
+      std::vector<unsigned char> sub(stride), up(stride);
+      for (std::size_t c = begin; c < end; ++c) {
+        const int first = int(c)*per, n = std::max(0, std::min(per, rows - first));
+        std::vector<unsigned char>& f = chunks[c].filtered;
+        f.resize(std::size_t(n)*(stride + 1));
+        for (int r = 0; r < n; ++r) {
+          const unsigned char* row = pending_.data() + std::size_t(first + r)*stride;
+          const unsigned char* prior = (first + r == 0) ? prior_.data() : row - stride;
+          png_filter_sub(row, stride, sub.data());
+          png_filter_up(row, prior, stride, up.data());
+          const bool useSub = png_filter_cost(sub.data(), stride) <= png_filter_cost(up.data(), stride);
+          unsigned char* out = f.data() + std::size_t(r)*(stride + 1);
+          out[0] = useSub ? 1 : 2;
+          std::copy(useSub ? sub.begin() : up.begin(), useSub ? sub.end() : up.end(), out + 1);
+        }
+      }
+    });
+
+    // every chunk is primed with the data before it, so the ratio is close
+    // to that of a single stream
+    parallel_chunks(chunks.size(), threads, [&](std::size_t begin, std::size_t end, unsigned) {
+      for (std::size_t c = begin; c < end; ++c) {
+        const std::vector<unsigned char>& dictionary = (c == 0) ? dictionary_ : chunks[c - 1].filtered;
+        deflate_chunk(chunks[c], dictionary, last && c + 1 == chunks.size());
+      }
+    });
+
+    for (Chunk& c : chunks) {
+      ok_ = ok_ && c.ok;
+      if (!started_) {
+        // zlib header: 32 KiB window, the level as a hint for decoders
+        const unsigned cmf = 0x78,
+                       flevel = (level_ == 1 || level_ == 0) ? 0 : (level_ > 1 && level_ < 6) ? 1 : (level_ > 6) ? 3 : 2;
+        unsigned flg = flevel << 6;
+        flg += 31 - (cmf*256 + flg) % 31;
+        c.compressed.insert(c.compressed.begin(), { (unsigned char)cmf, (unsigned char)flg });
+        started_ = true;
+      }
+      adler_ = adler32_combine(adler_, c.adler, z_off_t(c.filtered.size()));
+      if (last && &c == &chunks.back()) {
+        unsigned char trailer[4];
+        put32(trailer, unsigned(adler_));
+        c.compressed.insert(c.compressed.end(), trailer, trailer + 4);
+      }
+      chunk("IDAT", c.compressed.data(), c.compressed.size());
+    }
+
+    // keep what the next batch needs: the last row and the last 32 KiB
+    if (rows > 0) {
+      prior_.assign(pending_.end() - stride, pending_.end());
+    }
+    for (const Chunk& c : chunks) {
+      dictionary_.insert(dictionary_.end(), c.filtered.begin(), c.filtered.end());
+      if (dictionary_.size() > std::size_t(window)) {
+        dictionary_.erase(dictionary_.begin(), dictionary_.end() - window);
+      }
+    }
+    pending_.clear();
+  }
+
+  /* raw deflate of a chunk                                                  *
+   * PRE : c.filtered holds the data                                         *
+   * POST: c.compressed ends at a byte boundary (sync flush), or finishes the *
+   *       stream if 'last'. c.ok is false if zlib failed                     */
+  void deflate_chunk(Chunk& c, const std::vector<unsigned char>& dictionary, const bool last) const {
+    c.adler = adler32(adler32(0L, Z_NULL, 0), c.filtered.data(), uInt(c.filtered.size()));
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    c.ok = (deflateInit2(&stream, level_, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    if (!c.ok) {
+      return;
+    }
+    if (!dictionary.empty()) {
+      const std::size_t n = std::min(dictionary.size(), std::size_t(window));
+      deflateSetDictionary(&stream, dictionary.data() + dictionary.size() - n, uInt(n));
+    }
+
+    // the bound covers a finished stream, the flush marker needs a few bytes more
+    c.compressed.resize(deflateBound(&stream, uLong(c.filtered.size())) + 16);
+    stream.next_in = c.filtered.data();
+    stream.avail_in = uInt(c.filtered.size());
+    stream.next_out = c.compressed.data();
+    stream.avail_out = uInt(c.compressed.size());
+    const int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    c.ok = (last ? status == Z_STREAM_END : status == Z_OK) && stream.avail_in == 0;
+    c.compressed.resize(c.compressed.size() - stream.avail_out);
+    deflateEnd(&stream);
+  }
+
+  /* length, type, data and crc of a chunk */
+  void chunk(const char* type, const unsigned char* data, const std::size_t n) {
+    if (n == 0 && type[0] == 'I' && type[1] == 'D') {
+      return; // no empty IDAT chunks
+    }
+    unsigned char bytes[4];
+    put32(bytes, unsigned(n));
+    write(bytes, 4);
+    write(reinterpret_cast<const unsigned char*>(type), 4);
+    write(data, n);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(type), 4);
+    if (n > 0) {
+      crc = crc32(crc, data, uInt(n));
+    }
+    put32(bytes, unsigned(crc));
+    write(bytes, 4);
+  }
+
+  void write(const unsigned char* data, const std::size_t n) {
+    if (ok_ && n > 0) {
+      ok_ = sink_(data, n);
+      bytes_ += n;
+    }
+  }
+
+  /* big endian 32 bit integer */
+  static void put32(unsigned char* p, const unsigned v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)(v);
+  }
+
+  enum { window = 32768 }; // deflate window, the dictionary of a chunk
+
+  std::FILE* out_; // file written to, nullptr for a sink given by the user
+  Sink sink_; // destination of the encoded bytes
+  int width_, height_; // size of the image in pixels
+  int level_; // zlib compression level
+  int rows_; // rows added so far
+  std::size_t bytes_; // size of the file so far
+  bool ok_; // no error so far?
+  bool started_; // zlib header written?
+  uLong adler_; // adler32 of the data compressed so far
+  std::vector<unsigned char> pending_; // rows not compressed yet
+  std::vector<unsigned char> prior_; // row above the first pending row
+  std::vector<unsigned char> dictionary_; // last filtered bytes compressed, at most window
+};
+
+} // end namespace mgl
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef MGL_POOL_HPP
+#define MGL_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include "MglDaemon.hpp"
+#include "MglParallel.hpp"
+#ifdef __linux__
+  #include <csignal>
+  #include <sys/wait.h>
+#endif
+
+namespace mgl {
+
+#ifdef __linux__
+
+/* worker processes rendering the figures of Figure::save                    *
+ * NOTE: MathGL keeps process wide state (fonts, settings), so figures saved *
+ *       from several threads at once can disturb each other. While a pool   *
+ *       exists, Figure::save sends every figure to one of its workers       *
+ *       instead, as a scene in shared memory (see MglDaemon.hpp), so saves  *
+ *       from many threads run in parallel without sharing MathGL. A worker  *
+ *       that crashes takes only its figure with it and is replaced.         *
+ *       Workers are forked by a helper process, which is forked when the    *
+ *       pool is constructed: forking a process with running threads may     *
+ *       deadlock in the child, the helper stays single threaded             */
+class MglRenderPool {
+public:
+
+  /* start the helper and 'workers' worker processes                         *
+   * PRE : no other threads are running yet (construct it early in main)     *
+   * POST: good() tells if the workers could be started, Figure::save uses   *
+   *       this pool until it is destroyed                                   */
+  explicit MglRenderPool(const unsigned workers = hardware_threads())
+    : helper_(-1)
+    , control_(-1)
+    , live_(0)
+    , restarts_(0)
+  {
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0) {
+      std::cerr << "In function MglRenderPool::MglRenderPool(): Could not create a socket\n";
+      return;
+    }
+    helper_ = ::fork();
+    if (helper_ == 0) {
+      ::close(pair[0]);
+      helper(pair[1]);
+    }
+    ::close(pair[1]);
+    if (helper_ < 0) {
+      ::close(pair[0]);
+      std::cerr << "In function MglRenderPool::MglRenderPool(): Could not fork\n";
+      return;
+    }
+    control_ = pair[0];
+
+    for (unsigned k = 0; k < std::max(1u, workers); ++k) {
+      Worker w;
+      if (spawn(w)) {
+        idle_.push_back(w);
+        ++live_;
+      }
+    }
+    if (live_ > 0) {
+      pool() = this;
+    }
+  }
+
+  /* stop the workers and the helper                   *
+   * PRE : no save() or render() is running            *
+   * POST: Figure::save renders in the process again   */
+  ~MglRenderPool() {
+    if (pool() == this) {
+      pool() = nullptr;
+    }
+    // the workers and the helper exit when their socket is closed
+    for (const Worker& w : idle_) {
+      ::close(w.socket);
+    }
+    if (control_ >= 0) {
+      ::close(control_);
+    }
+    if (helper_ > 0) {
+      ::waitpid(helper_, nullptr, 0);
+    }
+  }
+
+  MglRenderPool(const MglRenderPool&) = delete;
+  MglRenderPool& operator=(const MglRenderPool&) = delete;
+
+  /* the pool Figure::save uses, nullptr if there is none */
+  static MglRenderPool* current() {
+    return pool();
+  }
+
+  bool good() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return live_ > 0;
+  }
+
+  /* number of workers that have been replaced after a crash */
+  unsigned restarts() const {
+    return restarts_;
+  }
+
+  /* save a figure with a worker                                               *
+   * PRE : scene writes the scene of the figure to a stream                    *
+   * POST: returns false if the pool can't save the figure (compressed format, *
+   *       no workers left), then the caller renders it. Otherwise a worker    *
+   *       has written 'file' in 'format' and bytes holds its size, 0 if the   *
+   *       worker failed or crashed twice on the figure                        */
+  bool save(const std::string& file, const std::string& format,
+            const std::function<bool(std::ostream&)>& scene, std::size_t& bytes) {
+    bytes = 0;
+    if (!daemon_format(format) || !good()) {
+      return false;
+    }
+    const int memory = scene_memfd(scene);
+    if (memory < 0) {
+      return false;
+    }
+    const int output = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    bool handled = true; // a file that can't be opened is an error of the save
+    if (output >= 0) {
+      handled = render(memory, format, output, bytes);
+      ::close(output);
+    }
+    ::close(memory);
+    return handled;
+  }
+
+  /* render a scene with a worker, see daemon_render                         *
+   * PRE : as for daemon_render                                              *
+   * POST: returns false if no worker is left. A figure whose worker crashed *
+   *       is tried once more on another worker                              */
+  bool render(const int scene, const std::string& format, const int output, std::size_t& bytes) {
+    bytes = 0;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      Worker w;
+      if (!acquire(w)) {
+        return false;
+      }
+      if (daemon_request(w.socket, scene, format, output, bytes)) {
+        release(w);
+        return true;
+      }
+      std::cerr << "* Figure - Warning * render worker " << w.pid << " died, starting a new one\n";
+      ::close(w.socket);
+      ++restarts_;
+      replace();
+    }
+    std::cerr << "In function MglRenderPool::render(): The figure crashed two workers!\n";
+    return true;
+  }
+
+private:
+
+  struct Worker {
+    pid_t pid;
+    int socket; // connection to the worker
+  };
+
+  static std::atomic<MglRenderPool*>& pool() {
+    static std::atomic<MglRenderPool*> current(nullptr);
+    return current;
+  }
+
+  /* wait for an idle worker, returns false if there are none left */
+  bool acquire(Worker& w) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    available_.wait(lock, [this]() { return !idle_.empty() || live_ == 0; });
+    if (idle_.empty()) {
+      return false;
+    }
+    w = idle_.back();
+    idle_.pop_back();
+    return true;
+  }
+
+  void release(const Worker& w) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      idle_.push_back(w);
+    }
+    available_.notify_one();
+  }
+
+  /* start a worker for one that died */
+  void replace() {
+    Worker w;
+    const bool started = spawn(w);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (started) {
+        idle_.push_back(w);
+      }
+      else {
+        --live_;
+      }
+    }
+    available_.notify_all();
+  }
+
+  /* ask the helper for a new worker                        *
+   * PRE : -                                                *
+   * POST: w is connected to the worker, false on failure   */
+  bool spawn(Worker& w) {
+    std::lock_guard<std::mutex> lock(controlMutex_);
+    const char command = 's';
+    if (control_ < 0 || !send_fds(control_, &command, 1, nullptr, 0)) {
+      return false;
+    }
+    std::int64_t pid = -1;
+    int fds[2], nfds = 0;
+    if (recv_fds(control_, &pid, sizeof(pid), fds, nfds) != long(sizeof(pid)) || pid <= 0 || nfds != 1) {
+      for (int i = 0; i < nfds; ++i) {
+        ::close(fds[i]);
+      }
+      return false;
+    }
+    w.pid = pid_t(pid);
+    w.socket = fds[0];
+    return true;
+  }
+
+  /* the helper: forks a worker for every request on 'control'              *
+   * PRE : runs in the forked helper process                                *
+   * POST: exits when the pool closes the socket                            */
+  static void helper(const int control) {
+    // the kernel reaps the workers, nobody waits for them
+    std::signal(SIGCHLD, SIG_IGN);
+    char command;
+    int fds[2], nfds = 0;
+    while (recv_fds(control, &command, 1, fds, nfds) == 1) {
+      for (int i = 0; i < nfds; ++i) {
+        ::close(fds[i]);
+      }
+      int pair[2];
+      std::int64_t pid = -1;
+      if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0) {
+        send_fds(control, &pid, sizeof(pid), nullptr, 0);
+        continue;
+      }
+      pid = ::fork();
+      if (pid == 0) {
+        ::close(control);
+        ::close(pair[0]);
+        worker(pair[1]);
+      }
+      ::close(pair[1]);
+      send_fds(control, &pid, sizeof(pid), pair, pid > 0 ? 1 : 0);
+      ::close(pair[0]);
+    }
+    ::_exit(0);
+  }
+
+  /* a worker: renders the requests of the pool with one warm graph *
+   * PRE : runs in a process forked by the helper                   *
+   * POST: exits when the pool closes the connection                */
+  static void worker(const int connection) {
+    std::signal(SIGCHLD, SIG_DFL);
+    {
+      mglGraph graph;
+      daemon_warm_up(graph);
+      daemon_serve(connection, graph);
+    }
+    ::_exit(0);
+  }
+
+  pid_t helper_; // process forking the workers
+  int control_; // connection to the helper
+  mutable std::mutex mutex_; // guards idle_ and live_
+  std::mutex controlMutex_; // one request to the helper at a time
+  std::condition_variable available_; // a worker became idle or died
+  std::vector<Worker> idle_; // workers waiting for a figure
+  unsigned live_; // workers running or starting
+  std::atomic<unsigned> restarts_; // workers replaced after a crash
+};
+
+#else // no fork and Unix sockets: figures are always rendered in the process
+
+class MglRenderPool {
+public:
+  explicit MglRenderPool(const unsigned = 1) {}
+
+  static MglRenderPool* current() {
+    return nullptr;
+  }
+
+  bool good() const {
+    return false;
+  }
+
+  bool save(const std::string&, const std::string&, const std::function<bool(std::ostream&)>&, std::size_t&) {
+    return false;
+  }
+};
+
+#endif
+
+} // end namespace mgl
+
+#endif
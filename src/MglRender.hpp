@@ -0,0 +1,74 @@
+#ifndef MGL_RENDER_HPP
+#define MGL_RENDER_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "MglArena.hpp"
+
+namespace mgl {
+
+/* state of one render pass of a Figure, handed to MglPlot::plot            *
+ * NOTE: not thread-safe, every thread rendering plots needs its own. The   *
+ *       scratch memory comes from the arena given to the context, which no *
+ *       other thread uses during the pass, and is released by the Figure   *
+ *       at the end of the pass                                             */
+struct MglRenderContext {
+  explicit MglRenderContext(MglArena& arena)
+    : clip_(false)
+    , ranges_{{0, 0, 0, 0}}
+    , zranges_{{0, 0}}
+    , width_(0)
+    , height_(0)
+    , tolerance_(0)
+    , view_{{0, 0}}
+    , lineTolerance_(0)
+    , logx_(false)
+    , logy_(false)
+    , logData_{{false, false}}
+    , arena_(&arena)
+  {}
+
+  /* buffer for n doubles, valid until the end of the render pass */
+  double* scratch(const std::size_t n) {
+    return arena_->allocate_array<double>(n);
+  }
+
+  /* buffer for n flags, valid until the end of the render pass */
+  unsigned char* mask(const std::size_t n) {
+    return arena_->allocate_array<unsigned char>(n);
+  }
+
+  bool clip_; // clip the data to the ranges before handing it to MathGL?
+  std::array<double, 4> ranges_; // x and y ranges of the plot
+  std::array<double, 2> zranges_; // z range of the plot
+  int width_, height_; // size of the plot region in pixels
+  double tolerance_; // points closer than this on the screen (in pixels) may be merged, 0 for none
+  std::array<double, 2> view_; // rotation angles of 3d plots, as given to mglGraph::Rotate
+  double lineTolerance_; // deviation of simplified 2d lines on the device (in pixels), 0 for none
+  bool logx_, logy_; // are the x and y axis log scaled?
+  std::array<bool, 2> logData_; // draw log10 of x and y data? then the axes are linear in log10 units
+                                // and ranges_ are log10 as well, see Figure::setLogTransform
+
+private:
+  MglArena* arena_; // scratch memory of this render pass
+};
+
+/* allocation counts and output size of the last render pass of a Figure */
+struct MglRenderStats {
+  std::size_t scratchBuffers; // temporary buffers used by the plots
+  std::size_t heapAllocations; // heap allocations needed for them
+  std::size_t scratchBytes; // size of the temporary buffers
+  std::size_t bytesWritten; // size of the saved file, 0 if it could not be written
+};
+
+/* memory held by a Figure and estimated for its next save, in bytes, see Figure::memoryUsage */
+struct MglMemoryUsage {
+  std::vector<std::size_t> plots; // data of every plot, those of the panels follow in panel order
+  std::size_t data; // data of all plots and the cached background
+  std::size_t savePeak; // estimated memory allocated by save() on top of data
+};
+
+} // end namespace mgl
+
+#endif
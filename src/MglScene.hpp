@@ -0,0 +1,291 @@
+#ifndef MGL_SCENE_HPP
+#define MGL_SCENE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <mgl2/mgl.h>
+
+namespace mgl {
+
+/* binary scene files written by Figure::serialize                          *
+ * Layout: the magic "MGLSCENE", the format version (u32) and the figure.    *
+ * All numbers are little endian, integers are u32/u64, floating point      *
+ * values IEEE doubles. Strings are stored as u64 length and bytes. Arrays  *
+ * are stored as their dimensions (3 x u64), zero padding up to the next    *
+ * multiple of MglScene::alignment bytes from the start of the file and the *
+ * raw values, so a memory-mapped file can be used in place                 *
+ * Versions: 1 first version, 2 adds the memory budget, 3 the log transform *
+ * and 4 the PNG compression of a figure. Scenes of older versions can be   *
+ * read, the fields they lack get their defaults                            */
+namespace MglScene {
+  const char magic[8] = { 'M', 'G', 'L', 'S', 'C', 'E', 'N', 'E' };
+  const std::uint32_t version = 4;
+  const std::size_t alignment = 64;
+
+  inline bool little_endian() {
+    const std::uint16_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+  }
+}
+
+/* writes the values of a scene to a stream, see MglScene */
+class MglSceneWriter {
+public:
+  explicit MglSceneWriter(std::ostream& out)
+    : out_(out)
+    , offset_(0)
+  {}
+
+  /* magic and version, at the start of the file */
+  void header() {
+    raw(MglScene::magic, sizeof(MglScene::magic));
+    u32(MglScene::version);
+  }
+
+  void u32(const std::uint32_t v) {
+    scalar(&v, sizeof(v));
+  }
+
+  void i32(const int v) {
+    const std::int32_t w = v;
+    scalar(&w, sizeof(w));
+  }
+
+  void u64(const std::uint64_t v) {
+    scalar(&v, sizeof(v));
+  }
+
+  void f64(const double v) {
+    scalar(&v, sizeof(v));
+  }
+
+  void str(const std::string& s) {
+    u64(s.size());
+    raw(s.data(), s.size());
+  }
+
+  /* n values, as an array of dimensions n x 1 x 1 */
+  void array(const double* a, const std::uint64_t n) {
+    u64(n);
+    u64(1);
+    u64(1);
+    values(a, n);
+  }
+
+  void data(const mglData& d) {
+    u64(std::uint64_t(d.GetNx()));
+    u64(std::uint64_t(d.GetNy()));
+    u64(std::uint64_t(d.GetNz()));
+    values(d.a, std::uint64_t(d.GetNx())*d.GetNy()*d.GetNz());
+  }
+
+  bool good() const {
+    return bool(out_);
+  }
+
+private:
+  /* the values are written in one go on little endian machines */
+  void values(const double* a, const std::uint64_t n) {
+    static const char zeros[MglScene::alignment] = {};
+    raw(zeros, (MglScene::alignment - offset_ % MglScene::alignment) % MglScene::alignment);
+    if (MglScene::little_endian()) {
+      raw(a, n*sizeof(double));
+    }
+    else {
+      for (std::uint64_t i = 0; i < n; ++i) {
+        f64(a[i]);
+      }
+    }
+  }
+
+  void scalar(const void* v, const std::size_t size) {
+    unsigned char bytes[8];
+    std::memcpy(bytes, v, size);
+    if (!MglScene::little_endian()) {
+      std::reverse(bytes, bytes + size);
+    }
+    raw(bytes, size);
+  }
+
+  void raw(const void* p, const std::size_t n) {
+    out_.write(static_cast<const char*>(p), std::streamsize(n));
+    offset_ += n;
+  }
+
+  std::ostream& out_;
+  std::size_t offset_; // bytes written so far, for the alignment of arrays
+};
+
+/* reads the values of a scene from a stream, see MglScene                 *
+ * NOTE: after the first failure all values read are 0 or empty and good() *
+ *       is false, so the caller only has to check at the end. Scenes may   *
+ *       come from other processes (see MglDaemon.hpp): if the stream can   *
+ *       seek, no length may exceed the bytes left, so a damaged length     *
+ *       fails instead of allocating more than the scene holds              */
+class MglSceneReader {
+public:
+  explicit MglSceneReader(std::istream& in)
+    : in_(in)
+    , offset_(0)
+    , ok_(bool(in))
+    , version_(0)
+    , available_(maxBytes)
+  {
+    std::streambuf* buffer = in.rdbuf();
+    const std::streamoff here = buffer ? std::streamoff(buffer->pubseekoff(0, std::ios::cur, std::ios::in)) : -1;
+    const std::streamoff end = here >= 0 ? std::streamoff(buffer->pubseekoff(0, std::ios::end, std::ios::in)) : -1;
+    if (end >= 0) {
+      buffer->pubseekpos(here, std::ios::in);
+      available_ = std::min(std::uint64_t(maxBytes), std::uint64_t(std::max<std::streamoff>(0, end - here)));
+    }
+  }
+
+  /* check the magic, returns the version (0 if this is no scene) */
+  std::uint32_t header() {
+    char magic[sizeof(MglScene::magic)] = {};
+    raw(magic, sizeof(magic));
+    if (!check(std::equal(magic, magic + sizeof(magic), MglScene::magic))) {
+      return 0;
+    }
+    version_ = u32();
+    return version_;
+  }
+
+  /* version of the scene, read by header() */
+  std::uint32_t version() const {
+    return version_;
+  }
+
+  std::uint32_t u32() {
+    std::uint32_t v = 0;
+    scalar(&v, sizeof(v));
+    return v;
+  }
+
+  int i32() {
+    std::int32_t v = 0;
+    scalar(&v, sizeof(v));
+    return v;
+  }
+
+  std::uint64_t u64() {
+    std::uint64_t v = 0;
+    scalar(&v, sizeof(v));
+    return v;
+  }
+
+  double f64() {
+    double v = 0;
+    scalar(&v, sizeof(v));
+    return v;
+  }
+
+  std::string str() {
+    const std::uint64_t n = u64();
+    if (!check(n <= remaining())) {
+      return std::string();
+    }
+    std::string s(std::size_t(n), '\0');
+    raw(&s[0], s.size());
+    return ok_ ? s : std::string();
+  }
+
+  /* values of an array, which may be empty */
+  std::vector<double> array() {
+    const std::uint64_t nx = u64(), ny = u64(), nz = u64();
+    if (!check(size_ok(nx, ny, nz))) {
+      return std::vector<double>();
+    }
+    std::vector<double> v(std::size_t(nx*ny*nz));
+    values(v.data(), v.size());
+    return v;
+  }
+
+  /* the values are read straight into the storage of the mglData */
+  mglData data() {
+    const std::uint64_t nx = u64(), ny = u64(), nz = u64();
+    if (!check(nx > 0 && ny > 0 && nz > 0 && size_ok(nx, ny, nz))) {
+      return mglData();
+    }
+    mglData d(static_cast<long>(nx), static_cast<long>(ny), static_cast<long>(nz));
+    values(d.a, nx*ny*nz);
+    return d;
+  }
+
+  bool good() const {
+    return ok_;
+  }
+
+  /* mark the scene as invalid if cond is false, returns cond */
+  bool check(const bool cond) {
+    ok_ = ok_ && cond;
+    return cond;
+  }
+
+private:
+  static const std::uint64_t maxBytes = std::uint64_t(1) << 40; // sanity limit for damaged files
+
+  void scalar(void* v, const std::size_t size) {
+    unsigned char bytes[8] = {};
+    raw(bytes, size);
+    if (!MglScene::little_endian()) {
+      std::reverse(bytes, bytes + size);
+    }
+    std::memcpy(v, bytes, size);
+  }
+
+  /* bytes the stream holds after the values read so far */
+  std::uint64_t remaining() const {
+    return available_ > offset_ ? available_ - offset_ : 0;
+  }
+
+  bool size_ok(const std::uint64_t nx, const std::uint64_t ny, const std::uint64_t nz) const {
+    const std::uint64_t values = remaining()/8;
+    return nx <= values && ny <= values && nz <= values
+        && (nx == 0 || ny == 0 || nz == 0 || nx <= values/ny/nz);
+  }
+
+  void values(double* a, const std::uint64_t n) {
+    skip((MglScene::alignment - offset_ % MglScene::alignment) % MglScene::alignment);
+    if (MglScene::little_endian()) {
+      raw(a, std::size_t(n)*sizeof(double));
+    }
+    else {
+      for (std::uint64_t i = 0; i < n; ++i) {
+        a[i] = f64();
+      }
+    }
+  }
+
+  void skip(const std::size_t n) {
+    char pad[MglScene::alignment];
+    raw(pad, n);
+  }
+
+  void raw(void* p, const std::size_t n) {
+    if (!ok_) {
+      return;
+    }
+    in_.read(static_cast<char*>(p), std::streamsize(n));
+    ok_ = (std::size_t(in_.gcount()) == n);
+    offset_ += n;
+  }
+
+  std::istream& in_;
+  std::size_t offset_; // bytes read so far, for the alignment of arrays
+  bool ok_; // no error so far?
+  std::uint32_t version_; // format version of the scene
+  std::uint64_t available_; // bytes of the stream from its start position, maxBytes if unknown
+};
+
+} // end namespace mgl
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef MGL_SIMPLIFY_HPP
+#define MGL_SIMPLIFY_HPP
+
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "MglParallel.hpp"
+
+namespace mgl {
+
+/* check if a MathGL line style draws markers                              *
+ * PRE : -                                                                 *
+ * POST: true if style contains a marker character outside of {...} color *
+ *       specifications. Plots with markers must keep all their points     */
+inline bool has_markers(const std::string& style)
+{
+  const std::string markers = ".+x*sdo^v<>#";
+  int depth = 0;
+  for (char c : style) {
+    if (c == '{') {
+      ++depth;
+    }
+    else if (c == '}') {
+      depth = std::max(0, depth - 1);
+    }
+    else if (depth == 0 && markers.find(c) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* check if a MathGL line style connects the points with a line          *
+ * PRE : -                                                                 *
+ * POST: false if style contains the dash ' ' (no line) outside of {...}  */
+inline bool draws_line(const std::string& style)
+{
+  int depth = 0;
+  for (char c : style) {
+    if (c == '{') {
+      ++depth;
+    }
+    else if (c == '}') {
+      depth = std::max(0, depth - 1);
+    }
+    else if (depth == 0 && c == ' ') {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* orthographic projection of 3d data to the screen, as done by MathGL for   *
+ * mglGraph::Rotate(tetX, tetZ) after SetRanges                              */
+struct MglProjection {
+  /* ranges = {xMin, xMax, yMin, yMax, zMin, zMax}, angles in degrees,       *
+   * pixels: number of pixels the range [-1, 1] of a normalized coordinate   *
+   * spans at most                                                           */
+  MglProjection(const std::array<double, 6>& ranges, const double tetX, const double tetZ, const double pixels)
+  {
+    const double pi = 3.14159265358979323846,
+                 cx = std::cos(tetX*pi/180), sx = std::sin(tetX*pi/180),
+                 cz = std::cos(tetZ*pi/180), sz = std::sin(tetZ*pi/180);
+    // rows 0 and 1 of Rx(tetX)*Rz(tetZ), the screen plane
+    const double r[2][3] = { { cz, -sz, 0 },
+                             { cx*sz, cx*cz, -sx } };
+    // fold the normalization to [-1, 1] and the scale to pixels into the matrix
+    for (int d = 0; d < 3; ++d) {
+      const double w = ranges[2*d + 1] - ranges[2*d],
+                   s = w > 0 ? 2/w : 0;
+      for (int k = 0; k < 2; ++k) {
+        m_[k][d] = 0.5*pixels*r[k][d]*s;
+      }
+      lo_[d] = ranges[2*d];
+    }
+  }
+
+  /* screen position of (x, y, z) in pixels, up to a constant offset */
+  void operator()(const double x, const double y, const double z, double& u, double& v) const {
+    const double a = x - lo_[0], b = y - lo_[1], c = z - lo_[2];
+    u = m_[0][0]*a + m_[0][1]*b + m_[0][2]*c;
+    v = m_[1][0]*a + m_[1][1]*b + m_[1][2]*c;
+  }
+
+private:
+  double m_[2][3]; // projection matrix, including the normalization
+  double lo_[3]; // lower ranges
+};
+
+/* simplify a 3d polyline in screen space                                    *
+ * PRE : in[d] point to n values and out[d] to n free values for d < 3       *
+ * POST: points closer than 'tolerance' pixels on the screen to the last     *
+ *       kept point are dropped, so the drawn line moves by less than        *
+ *       'tolerance' pixels. The first and last point of every run between   *
+ *       NaN are kept, as are the NaN. Chunks of the line are simplified in  *
+ *       parallel. Returns the number of points written to out               */
+inline long simplify_projected(const double* const* in, const long n, const MglProjection& project,
+                               const double tolerance, double* const* out)
+{
+  const double tol2 = tolerance*tolerance;
+  const unsigned chunks = unsigned(std::min<long>(hardware_threads(), 1 + n/(1 << 15)));
+  std::vector<long> kept(chunks, 0), first(chunks, 0);
+
+  // every chunk writes to its own part of out, starting at its first index
+  parallel_chunks(std::size_t(n), chunks, [&](std::size_t begin, std::size_t end, unsigned k) {
+    long m = long(begin);
+    double lu = 0, lv = 0; // screen position of the last kept point
+    bool run = false; // is there a kept point in the current run?
+    for (std::size_t i = begin; i < end; ++i) {
+      const double x = in[0][i], y = in[1][i], z = in[2][i];
+      double u, v;
+      project(x, y, z, u, v);
+      const bool finite = std::isfinite(u) && std::isfinite(v);
+      // last point of a run or of the chunk
+      const bool last = i + 1 == end || !std::isfinite(in[0][i + 1] + in[1][i + 1] + in[2][i + 1]);
+      if (!finite || !run || last || (u - lu)*(u - lu) + (v - lv)*(v - lv) >= tol2) {
+        out[0][m] = x;
+        out[1][m] = y;
+        out[2][m] = z;
+        ++m;
+        lu = u;
+        lv = v;
+        run = finite;
+      }
+    }
+    first[k] = long(begin);
+    kept[k] = m - long(begin);
+  });
+
+  // close the gaps between the chunks
+  long m = kept[0];
+  for (unsigned k = 1; k < chunks; ++k) {
+    for (int d = 0; d < 3; ++d) {
+      std::memmove(out[d] + m, out[d] + first[k], kept[k]*sizeof(double));
+    }
+    m += kept[k];
+  }
+  return m;
+}
+
+/* map from data coordinates of one axis to device pixels, for linear and log axes */
+struct MglAxisMap {
+  /* [lo, hi]: range of the axis, pixels: length of the axis on the device */
+  MglAxisMap(const double lo, const double hi, const double pixels, const bool log)
+    : log_(log)
+  {
+    const double a = log ? std::log10(lo) : lo,
+                 b = log ? std::log10(hi) : hi;
+    scale_ = (b > a && std::isfinite(b - a)) ? pixels/(b - a) : 0;
+    offset_ = std::isfinite(a) ? a : 0;
+  }
+
+  double operator()(const double v) const {
+    return ((log_ ? std::log10(v) : v) - offset_)*scale_;
+  }
+
+private:
+  bool log_; // logarithmic axis?
+  double scale_, offset_; // pixels = (v - offset_)*scale_
+};
+
+/* simplify a 2d polyline for vector output, in linear time                  *
+ * PRE : x, y point to n values, xo, yo to n free values                     *
+ * POST: points are dropped as long as they stay within half of 'tolerance' *
+ *       device pixels of the line through the last kept point in the        *
+ *       direction of the line, and move forward on it (Reumann-Witkam). The *
+ *       kept segment ends at the last of them, which may be off the line    *
+ *       by as much, so every dropped point is within 'tolerance' of it.     *
+ *       Collinear runs are merged to one segment. The first and last point  *
+ *       of every run between NaN are kept, as are the NaN. Returns the      *
+ *       number of points written to xo, yo                                  */
+inline long simplify_polyline(const double* x, const double* y, const long n,
+                              const MglAxisMap& mx, const MglAxisMap& my,
+                              const double tolerance, double* xo, double* yo)
+{
+  // a point p dropped at position 'along' of a line ending 'across' off it
+  // at position t >= along is across_p + across*along/t from the segment
+  const double half = 0.5*tolerance;
+  long m = 0;
+  double au = 0, av = 0; // anchor: last kept point on the device
+  double du = 0, dv = 0; // unit direction of the current line, 0 if none yet
+  double t = 0; // position of the last point along the current line
+  bool run = false; // is there an anchor in the current run?
+  long prev = -1; // last point that has not been kept yet
+
+  for (long i = 0; i < n; ++i) {
+    const double u = mx(x[i]), v = my(y[i]);
+    if (!(std::isfinite(u) && std::isfinite(v))) {
+      // end the run: keep its last point and the gap
+      if (prev >= 0) {
+        xo[m] = x[prev]; yo[m] = y[prev]; ++m;
+        prev = -1;
+      }
+      xo[m] = x[i]; yo[m] = y[i]; ++m;
+      run = false;
+      continue;
+    }
+    if (!run) {
+      xo[m] = x[i]; yo[m] = y[i]; ++m;
+      au = u; av = v; du = dv = 0; t = 0;
+      run = true;
+      continue;
+    }
+
+    const double eu = u - au, ev = v - av;
+    if (du == 0 && dv == 0) {
+      // no direction yet: take the first point beyond the tolerance
+      const double len = std::sqrt(eu*eu + ev*ev);
+      if (len >= tolerance) {
+        du = eu/len; dv = ev/len;
+        t = len;
+      }
+      prev = i;
+      continue;
+    }
+
+    const double along = eu*du + ev*dv,
+                 across = std::abs(eu*dv - ev*du);
+    if (across < half && along >= t) {
+      // still on the line and moving forward
+      t = along;
+      prev = i;
+      continue;
+    }
+
+    // leaving the line: the previous point becomes the new anchor
+    xo[m] = x[prev]; yo[m] = y[prev]; ++m;
+    au = mx(x[prev]); av = my(y[prev]);
+    const double fu = u - au, fv = v - av,
+                 len = std::sqrt(fu*fu + fv*fv);
+    if (len >= tolerance) {
+      du = fu/len; dv = fv/len;
+      t = len;
+    }
+    else {
+      du = dv = 0;
+      t = 0;
+    }
+    prev = i;
+  }
+  if (prev >= 0) {
+    xo[m] = x[prev]; yo[m] = y[prev]; ++m;
+  }
+  return m;
+}
+
+/* reduce a 2d polyline with sorted x to at most 4 points per device column *
+ * PRE : x sorted apart from NaN gaps, x, y point to n values, xo, yo to n   *
+ *       free values                                                         *
+ * POST: of the points in a column of pixels the first, the last and those   *
+ *       with the smallest and the largest y are kept in their order, so the *
+ *       rasterized line does not change (M4). Points that are not on the    *
+ *       device, e.g. NaN gaps, are kept. Returns the number of points       *
+ *       written to xo, yo                                                   */
+inline long decimate_columns(const double* x, const double* y, const long n,
+                             const MglAxisMap& mx, const MglAxisMap& my, double* xo, double* yo)
+{
+  long m = 0;
+  long begin = 0; // first point of the current column
+  while (begin < n) {
+    const double u = mx(x[begin]);
+    if (!(std::isfinite(u) && std::isfinite(my(y[begin])))) {
+      xo[m] = x[begin]; yo[m] = y[begin]; ++m;
+      ++begin;
+      continue;
+    }
+
+    const double column = std::floor(u);
+    long end = begin + 1, lo = begin, hi = begin;
+    for (; end < n; ++end) {
+      const double ue = mx(x[end]);
+      if (!(std::isfinite(ue) && std::isfinite(my(y[end]))) || std::floor(ue) != column) {
+        break;
+      }
+      lo = y[end] < y[lo] ? end : lo;
+      hi = y[end] > y[hi] ? end : hi;
+    }
+
+    // first, extremes and last point, in order and without repetition
+    const long keep[4] = { begin, std::min(lo, hi), std::max(lo, hi), end - 1 };
+    for (int k = 0; k < 4; ++k) {
+      if (k == 0 || keep[k] != keep[k - 1]) {
+        xo[m] = x[keep[k]]; yo[m] = y[keep[k]]; ++m;
+      }
+    }
+    begin = end;
+  }
+  return m;
+}
+
+} // end namespace mgl
+
+#endif
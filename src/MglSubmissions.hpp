@@ -0,0 +1,156 @@
+#ifndef MGL_SUBMISSIONS_HPP
+#define MGL_SUBMISSIONS_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "MglPlot.hpp"
+
+namespace mgl {
+
+/* plots and legend labels submitted to a figure, possibly from several      *
+ * threads at once                                                           *
+ * NOTE: a submitter draws a ticket before it converts its data and submits  *
+ *       the finished entry with a lock free push. The thread owning the     *
+ *       figure takes the entries in ticket order, an entry whose            *
+ *       predecessor is still being converted waits for it. So styles are    *
+ *       assigned in the order of the tickets, whatever thread finishes      *
+ *       first. A ticket that is dropped without its entry, e.g. because     *
+ *       the conversion threw, is submitted as a cancelled entry, which only *
+ *       lets the entries after it through                                   */
+class MglSubmissions {
+public:
+
+  struct Entry {
+    unsigned long ticket;
+    std::unique_ptr<MglPlot> plot; // nullptr for a legend label
+    bool lineStyle; // does the plot take its style from the style deque?
+    std::pair<std::string, std::string> label; // label and style of a legend entry without plot
+    bool cancelled; // submitted for a ticket that was dropped, nothing to add
+    Entry* next; // in the list of submitted entries
+  };
+
+  /* a drawn ticket, its entry is owed to the list                          *
+   * NOTE: the entry is allocated before the ticket is drawn, so dropping   *
+   *       the ticket can submit it as cancelled without allocating         */
+  class Ticket {
+  public:
+    explicit Ticket(MglSubmissions& list)
+      : list_(&list)
+      , entry_(new Entry{ 0, nullptr, false, std::pair<std::string, std::string>(), true, nullptr })
+    {
+      entry_->ticket = list.tickets_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Ticket(Ticket&& other)
+      : list_(other.list_)
+      , entry_(other.entry_)
+    {
+      other.entry_ = nullptr;
+    }
+
+    ~Ticket() {
+      if (entry_) {
+        list_->submit(entry_);
+      }
+    }
+
+    Ticket(const Ticket&) = delete;
+    Ticket& operator=(const Ticket&) = delete;
+    Ticket& operator=(Ticket&&) = delete;
+
+    /* submit a plot, nullptr for a legend label                    *
+     * PRE : the ticket has not been submitted yet                  *
+     * POST: the list owns plot, safe from any thread                */
+    void submit(MglPlot* plot, const bool lineStyle, const std::pair<std::string, std::string>& label) {
+      Entry* e = entry_;
+      entry_ = nullptr;
+      e->plot.reset(plot);
+      e->lineStyle = lineStyle;
+      e->cancelled = false;
+      try {
+        e->label = label;
+      }
+      catch (...) {
+        e->cancelled = true;
+        list_->submit(e);
+        throw;
+      }
+      list_->submit(e);
+    }
+
+  private:
+    MglSubmissions* list_;
+    Entry* entry_; // nullptr once submitted
+  };
+
+  MglSubmissions()
+    : tickets_(0)
+    , head_(nullptr)
+    , taken_(0)
+  {}
+
+  ~MglSubmissions() {
+    for (Entry* e = head_.load(); e; ) {
+      Entry* next = e->next;
+      delete e;
+      e = next;
+    }
+  }
+
+  MglSubmissions(const MglSubmissions&) = delete;
+  MglSubmissions& operator=(const MglSubmissions&) = delete;
+
+  /* next ticket, call once per entry before converting its data */
+  Ticket ticket() {
+    return Ticket(*this);
+  }
+
+  /* entries ready to be added                                                *
+   * PRE : only called by the thread owning the figure                        *
+   * POST: returns the entries whose tickets follow the last taken one        *
+   *       without gap, in ticket order, without the cancelled ones. Later    *
+   *       entries are kept until the missing ones have been submitted        */
+  std::vector<std::unique_ptr<Entry> > take() {
+    for (Entry* e = head_.exchange(nullptr, std::memory_order_acquire); e; ) {
+      Entry* next = e->next;
+      waiting_.emplace_back(e);
+      e = next;
+    }
+    std::sort(waiting_.begin(), waiting_.end(),
+              [](const std::unique_ptr<Entry>& a, const std::unique_ptr<Entry>& b) { return a->ticket < b->ticket; });
+
+    std::size_t n = 0;
+    std::vector<std::unique_ptr<Entry> > ready;
+    while (n < waiting_.size() && waiting_[n]->ticket == taken_) {
+      if (!waiting_[n]->cancelled) {
+        ready.push_back(std::move(waiting_[n]));
+      }
+      ++n;
+      ++taken_;
+    }
+    waiting_.erase(waiting_.begin(), waiting_.begin() + n);
+    return ready;
+  }
+
+private:
+  /* submit an entry of a ticket                               *
+   * PRE : e has been allocated with new, e->ticket is unused  *
+   * POST: e is owned by this list, safe from any thread        */
+  void submit(Entry* e) {
+    e->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(e->next, e, std::memory_order_release, std::memory_order_relaxed)) {}
+  }
+
+  std::atomic<unsigned long> tickets_; // next ticket
+  std::atomic<Entry*> head_; // submitted entries, last submitted first
+  unsigned long taken_; // next ticket to take
+  std::vector<std::unique_ptr<Entry> > waiting_; // taken from head_, waiting for a missing ticket
+};
+
+} // end namespace mgl
+
+#endif
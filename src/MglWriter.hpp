@@ -0,0 +1,156 @@
+#ifndef MGL_WRITER_HPP
+#define MGL_WRITER_HPP
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <mgl2/mgl.h>
+#include "MglPng.hpp"
+
+namespace mgl {
+
+/* size of a file in bytes, 0 if it can't be opened */
+inline std::size_t file_size(const std::string& file)
+{
+  std::ifstream in(file.c_str(), std::ios::binary | std::ios::ate);
+  if (!in) {
+    return 0;
+  }
+  const std::streamoff size = in.tellg();
+  return size > 0 ? std::size_t(size) : 0;
+}
+
+/* output format of Figure::save, selected by the extension of the file      *
+ * write: stores the graph in the file and returns the number of bytes       *
+ *        written, 0 on failure                                              *
+ * vector: does the format store the lines point by point? then they are     *
+ *         simplified before writing (see MglRenderContext::lineTolerance_)  */
+struct MglFormat {
+  typedef std::function<std::size_t(mglGraph& gr, const std::string& file)> Writer;
+
+  std::string extension; // e.g. ".svgz", including the dot
+  bool vector;
+  Writer write;
+};
+
+/* formats known to Figure::save                                             *
+ * NOTE: MathGL compresses EPS and SVG output with zlib while writing it if  *
+ *       the file name ends with 'z', so .svgz and .eps.gz need no temporary *
+ *       file. Formats can be added (or replaced) by the user with add()     */
+class MglWriterRegistry {
+public:
+
+  static MglWriterRegistry& instance() {
+    static MglWriterRegistry registry;
+    return registry;
+  }
+
+  /* register a format                                                   *
+   * PRE : extension starts with a dot                                   *
+   * POST: files ending with extension are written with write, replacing *
+   *       a format registered before for the same extension             */
+  void add(const std::string& extension, const bool vector, MglFormat::Writer write) {
+    for (auto& f : formats_) {
+      if (f.extension == extension) {
+        f.vector = vector;
+        f.write = write;
+        return;
+      }
+    }
+    formats_.push_back(MglFormat{ extension, vector, write });
+  }
+
+  /* format of a file                                                      *
+   * PRE : -                                                               *
+   * POST: returns the format with the longest extension the file name     *
+   *       ends with (so .eps.gz wins over .gz), nullptr if there is none  */
+  const MglFormat* find(const std::string& file) const {
+    const MglFormat* best = nullptr;
+    for (const auto& f : formats_) {
+      const std::size_t n = f.extension.size();
+      if (file.size() > n && file.compare(file.size() - n, n, f.extension) == 0
+          && (!best || n > best->extension.size())) {
+        best = &f;
+      }
+    }
+    return best;
+  }
+
+  /* the built-in PNG format, with the parallel encoder of MglPngWriter */
+  static const MglFormat& png() {
+    static const MglFormat format{ ".png", false, write_png };
+    return format;
+  }
+
+  /* is f the built-in PNG format?                                          *
+   * PRE : -                                                                *
+   * POST: false for any other format, also for a .png writer of the user  *
+   *       that replaced the built-in one with add()                        */
+  static bool is_png(const MglFormat& f) {
+    typedef std::size_t (*Function)(mglGraph&, const std::string&);
+    const Function* write = f.write.target<Function>();
+    return f.extension == ".png" && write && *write == &write_png;
+  }
+
+  /* format registered for an extension                                 *
+   * PRE : -                                                            *
+   * POST: returns the format of exactly 'extension', nullptr if none    */
+  const MglFormat* get(const std::string& extension) const {
+    for (const auto& f : formats_) {
+      if (f.extension == extension) {
+        return &f;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+
+  MglWriterRegistry() {
+    // MathGL writers don't report errors, the size of the file tells
+    auto mathgl = [](void (mglGraph::*writer)(const char*, const char*)) {
+      return [writer](mglGraph& gr, const std::string& file) {
+        (gr.*writer)(file.c_str(), "");
+        return file_size(file);
+      };
+    };
+
+    add(".png", false, write_png);
+    add(".eps", true, mathgl(&mglGraph::WriteEPS));
+    add(".eps.gz", true, mathgl(&mglGraph::WriteEPS));
+    add(".svg", true, mathgl(&mglGraph::WriteSVG));
+    add(".svgz", true, mathgl(&mglGraph::WriteSVG));
+    add(".bmp", false, mathgl(&mglGraph::WriteBMP));
+    add(".jpg", false, mathgl(&mglGraph::WriteJPEG));
+    add(".jpeg", false, mathgl(&mglGraph::WriteJPEG));
+    add(".rgba", false, write_rgba);
+  }
+
+  /* PNG with the parallel encoder, see MglPngWriter */
+  static std::size_t write_png(mglGraph& gr, const std::string& file) {
+    MglPngWriter png(file, gr.GetWidth(), gr.GetHeight());
+    png.write_rows(gr.GetRGBA(), gr.GetHeight());
+    return png.close();
+  }
+
+  /* raw 8 bit RGBA pixels, row by row from the top, without header */
+  static std::size_t write_rgba(mglGraph& gr, const std::string& file) {
+    std::FILE* out = std::fopen(file.c_str(), "wb");
+    if (!out) {
+      return 0;
+    }
+    const std::size_t pixels = std::size_t(gr.GetWidth())*gr.GetHeight();
+    const std::size_t written = std::fwrite(gr.GetRGBA(), 4, pixels, out);
+    const bool ok = (std::fclose(out) == 0 && written == pixels);
+    return ok ? 4*pixels : 0;
+  }
+
+  std::vector<MglFormat> formats_;
+};
+
+} // end namespace mgl
+
+#endif
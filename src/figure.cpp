@@ -11,11 +11,78 @@
 # include "MglPlot.hpp"
 # include "MglLabel.hpp"
 # include "MglStyle.hpp"
+# include "MglParallel.hpp"
+# include "MglDaemon.hpp"
+# include "MglPool.hpp"
 # include "figure.hpp"
 
 namespace mgl {
 
 
+/* graph holding the 'heros' font                                          *
+ * PRE : -                                                                  *
+ * POST: the font files are read by the first call only, every graph copies *
+ *       the font from here (reading them takes longer than most renders)   */
+static mglGraph& fontGraph()
+{
+  static mglGraph fonts;
+  static const bool loaded = (fonts.LoadFont("heros"), true);
+  (void)loaded;
+  return fonts;
+}
+
+/* estimates of memoryUsage(), in bytes                                     *
+ * NOTE: a MathGL canvas holds color, depth and alpha of 3 layers and the    *
+ *       final image per pixel, a stored primitive point its position,       *
+ *       normal, color and texture coordinates                              */
+static const std::size_t canvasBytes = 36; // per pixel of a canvas
+static const std::size_t primitiveBytes = 128; // per point stored by MathGL
+static const std::size_t scratchBytes = 24; // per point for the clipped and simplified copies of a plot
+
+/* bytes of a canvas kept by a figure, 0 if there is none */
+static std::size_t canvas_bytes(const std::unique_ptr<mglGraph>& graph)
+{
+  return graph ? canvasBytes*std::size_t(graph->GetWidth())*std::size_t(graph->GetHeight()) : 0;
+}
+
+/* tick labels for a log scaled axis drawn linear in log10 units             *
+ * PRE : lo < hi are the log10 of the range of the axis                      *
+ * POST: 'axis' of gr is labelled 10^{k} at the integers k in [lo, hi], at   *
+ *       most 8 of them. Ranges with less than two such k get the values     *
+ *       m*10^k, m = 1..9 (or 1, 2, 5 if these are too many) instead         */
+static void log_ticks(mglGraph& gr, const char axis, const double lo, const double hi)
+{
+  std::vector<double> values;
+  std::ostringstream labels;
+  const double first = std::ceil(lo), last = std::floor(hi);
+  if (last > first) {
+    const double step = std::ceil((last - first + 1)/8);
+    for (double k = first; k <= last; k += step) {
+      labels << (values.empty() ? "" : "\n") << "10^{" << k << "}";
+      values.push_back(k);
+    }
+  }
+  else {
+    const bool dense = (hi - lo < 0.7); // about 5 of the 9 mantissas at most
+    for (double k = std::floor(lo); k <= last; ++k) {
+      for (int m = 1; m <= 9; ++m) {
+        const double v = k + std::log10(double(m));
+        if (v >= lo && v <= hi && (dense || m == 1 || m == 2 || m == 5)) {
+          labels << (values.empty() ? "" : "\n") << m*std::pow(10., k);
+          values.push_back(v);
+        }
+      }
+    }
+  }
+  if (values.empty()) {
+    labels << std::pow(10., lo) << "\n" << std::pow(10., hi);
+    values = {lo, hi};
+  }
+  mglData v;
+  v.Link(values.data(), long(values.size()));
+  gr.SetTicksVal(axis, v, labels.str().c_str());
+}
+
 void print(const mglData& d)
 {
   for (long i = 0; i < d.GetNx(); ++i){
@@ -39,6 +106,9 @@ Figure::Figure()
           std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest()}),
     zranges_({std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest()}),
     aspects_({1, 1, 1}), // normal axis, no shearing
+    view_({60, 30}), // point of view for 3d plots
+    lineTolerance_(0),
+    vectorSave_(false),
     autoRanges_(true),
     styles_(MglStyle()),
     fontSizePT_(6), // small font size
@@ -47,9 +117,35 @@ Figure::Figure()
     figHeight_(-1), // set to -1: later we will check if they have been changed manually, -1 means no
     figWidth_(-1),  //            any other value will mean that they've been changed
     topMargin_(-1),
-    leftMargin_(-1)
+    leftMargin_(-1),
+    concurrent_(false), // plots are added by the thread owning the figure
+    layers_(1), // render sequentially by default
+    tileHeight_(0), // render the image at once
+    caching_(false), // full render on every save
+    rows_(0), // no subplots
+    cols_(0),
+    animStream_(nullptr),
+    quality_(Quality::Normal),
+    compression_(Compression::Default),
+    pngSink_(nullptr),
+    memoryBudget_(0), // no limit
+    lowMemory_(false),
+    logTransform_(false), // MathGL scales log axes
+    logData_{{false, false}},
+    renderStats_{0, 0, 0, 0}
+
+{
+  reserveArenas(1); // for the plots drawn by the calling thread
+}
 
-{}
+/* destructor                                       *
+ * PRE : -                                          *
+ * POST: a running animation is finished and closed */
+Figure::~Figure() {
+  if (animGraph_) {
+    endAnimation();
+  }
+}
 
 
 /* setting height of the plot                                    *
@@ -113,11 +209,115 @@ void Figure::setFontSize(const int size) {
   fontSizePT_ = size;
 }
 
+/* setting the number of render layers                                    *
+ * PRE : -                                                                 *
+ * POST: the plots will be rasterized on 'layers' canvases in parallel and *
+ *       composited in plot order, for layers <= 1 they will be rendered   *
+ *       sequentially on one canvas                                        */
+void Figure::setLayers(const int layers) {
+  layers_ = layers;
+}
+
+/* setting the height of the bands for tiled rendering                      *
+ * PRE : -                                                                   *
+ * POST: PNGs higher than 'rows' are rendered in bands of 'rows' image rows  *
+ *       that are streamed to the file, so the memory needed depends on the  *
+ *       band size and not on the size of the image. layers_ bands are       *
+ *       rendered in parallel. rows <= 0 renders the image at once (default) */
+void Figure::setTileHeight(const int rows) {
+  tileHeight_ = rows;
+}
+
+/* setting the caching of repeated saves                                    *
+ * PRE : -                                                                   *
+ * POST: if enabled, raster formats keep title, labels, grid, axis and the   *
+ *       plots that did not change since the last save on a background       *
+ *       canvas. A save only rasterizes the changed plots on top of it. The  *
+ *       background is redrawn when the ranges or the layout change, when a  *
+ *       plot on it changes or when plots are removed                        */
+void Figure::setCaching(const bool cache) {
+  caching_ = cache;
+  if (!cache) {
+    cache_.reset();
+  }
+}
+
+/* setting the concurrent submission of plots                                *
+ * PRE : -                                                                   *
+ * POST: if enabled, plot, plot3, bar, hist, fplot, surf, heatmap, contour   *
+ *       and addlabel may be called from several threads at once. The data   *
+ *       is converted by the calling thread without any lock, the finished   *
+ *       plot is queued lock free and added at the next save(), frame() or   *
+ *       serialize(). Styles are assigned in the order the calls started,    *
+ *       so the output does not depend on which conversion ends first        *
+ * NOTE: all other member functions, including density and spy, must not    *
+ *       run concurrently with the submissions. Plots without a style get    *
+ *       theirs when they are added, so set style and width after the save  */
+void Figure::setConcurrent(const bool concurrent) {
+  concurrent_ = concurrent;
+  if (!concurrent) {
+    collect();
+  }
+}
+
+/* setting the render quality                                              *
+ * PRE : -                                                                   *
+ * POST: Preview  : no antialiasing, direct drawing to the bitmap, default   *
+ *                  font and no tick tuning. For thumbnails and previews     *
+ *       Normal   : MathGL default quality (default)                         *
+ *       Publication: highest MathGL quality                                 */
+void Figure::setQuality(const Quality quality) {
+  quality_ = quality;
+}
+
+/* setting the compression of PNGs                                          *
+ * PRE : -                                                                   *
+ * POST: Fast   : zlib level 1, for previews and large images                *
+ *       Default: zlib level 6 (default)                                     *
+ *       Best   : zlib level 9, smallest files                               *
+ *       save() writes PNGs with its own encoder, which filters and deflates *
+ *       chunks of rows in parallel (see MglPngWriter), unless another .png  *
+ *       writer has been registered, which gets the whole image             */
+void Figure::setCompression(const Compression compression) {
+  compression_ = compression;
+}
+
+/* setting the memory budget                                                 *
+ * PRE : -                                                                   *
+ * POST: the data of the plots, including those of the panels, and the       *
+ *       memory a save needs are kept below 'bytes' where possible, see      *
+ *       memoryUsage(). Over the budget a save draws without storing the     *
+ *       primitives (raster formats), on one canvas and, for PNG, in bands.  *
+ *       If that is not enough, and whenever the data alone exceed the       *
+ *       budget, line plots are decimated to the pixels of the plot, largest *
+ *       first, and scatter plots are replaced by density plots. Every step  *
+ *       prints a warning. bytes = 0 means no limit (default)                */
+void Figure::setMemoryBudget(const std::size_t bytes) {
+  memoryBudget_ = bytes;
+}
+
+/* setting the pretransform of log scaled axes                               *
+ * PRE : -                                                                   *
+ * POST: if enabled, saves draw x-y plots on log scaled x and y axes (see    *
+ *       setlog) from log10 of their data on linear axes labelled 10^k,     *
+ *       instead of MathGL evaluating lg() for every vertex. The log10 data  *
+ *       are computed once per plot in a parallel, vectorized pass and kept  *
+ *       until the data change. Points that are not positive are left out,   *
+ *       MglPlot::dropped() counts them instead of a warning for every plot. *
+ *       Figures with other kinds of plots, 3d plots or ranges that are not  *
+ *       positive keep the log axes of MathGL                                */
+void Figure::setLogTransform(const bool transform) {
+  logTransform_ = transform;
+}
+
 /* enable to manually add legend entries       *
  * PRE : -                                     *
  * POST: label + style are added to the legend */
 void Figure::addlabel(const std::string& label, const std::string& style) {
-  additionalLabels_.push_back(std::pair<std::string, std::string>(label, style));
+  submissions_.ticket().submit(nullptr, false, std::make_pair(label, style));
+  if (!concurrent_) {
+    collect();
+  }
 }
 
 /* change grid settings                                                         *
@@ -178,19 +378,129 @@ MglPlot& Figure::fplot(const std::string& function, std::string style)
   std::cout << "Called fplot!\n";
 #endif
 
-  // checking if a style is given, 
-  // if yes: use it and delete it from the style-container,
-  // if no: get a style from the style container
-  if (style.size() == 0) {
-    style = styles_.get_next();
+  // put the plot in the plot queue, without a style a new one is taken
+  // from the style-container, otherwise it is removed from the container
+  return submit(submissions_.ticket(), new MglFPlot(function, style), true);
+}
+
+/* plot a histogram                                                           *
+ * PRE : -                                                                    *
+ * POST: the counts of histogram are added as bar plot at the bin centers,    *
+ *       e.g. for a histogram filled chunk by chunk with MglHistogram::add    */
+MglPlot& Figure::hist(const MglHistogram& histogram, const std::string& style)
+{
+  return bar(histogram.centers(), histogram.counts(), style);
+}
+
+/* field plot of a raw row-major field                                       *
+ * PRE : Z(i,j) = Z[i*rowStride + j]                                         *
+ * POST: returns a new plot, contiguous fields are linked without a copy,    *
+ *       strided ones copied                                                 */
+static MglFieldPlot* make_field(const double* Z, const long rows, const long cols, const long rowStride,
+                                const MglFieldPlot::Kind kind, const std::string& style)
+{
+  if (rowStride == cols) {
+    return new MglFieldPlot(Z, rows, cols, kind, style);
   }
-  else {
-    styles_.eliminate(style);
+
+  mglData zd(cols, rows);
+  for (long i = 0; i < rows; ++i) {
+    std::copy(Z + i*rowStride, Z + i*rowStride + cols, zd.a + i*cols);
+  }
+  return new MglFieldPlot(zd, kind, style);
+}
+
+/* surface plot of a row-major field                                          *
+ * PRE : Z(i,j) = Z[i*rowStride + j], rowStride >= cols                      *
+ * POST: as surf(Eigen::Matrix). If rowStride == cols Z is not copied and    *
+ *       must not be changed or freed until the figure is saved              */
+MglPlot& Figure::surf(const double* Z, const long rows, const long cols, const long rowStride, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  return field(std::move(ticket), make_field(Z, rows, cols, rowStride, MglFieldPlot::Surf, style));
+}
+
+/* heatmap of a row-major field                                  *
+ * PRE : as for surf                                             *
+ * POST: as heatmap(Eigen::Matrix), Z is not copied if contiguous */
+MglPlot& Figure::heatmap(const double* Z, const long rows, const long cols, const long rowStride, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  return field(std::move(ticket), make_field(Z, rows, cols, rowStride, MglFieldPlot::Heatmap, style));
+}
+
+/* contour plot of a row-major field                             *
+ * PRE : as for surf, levels > 0                                 *
+ * POST: as contour(Eigen::Matrix), Z is not copied if contiguous */
+MglPlot& Figure::contour(const double* Z, const long rows, const long cols, const long rowStride, const int levels, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  MglFieldPlot* p = make_field(Z, rows, cols, rowStride, MglFieldPlot::Contour, style);
+  p->levels(levels);
+  return field(std::move(ticket), p);
+}
+
+/* add a field plot to the plot queue                                      *
+ * PRE : plot has been allocated with new, it is owned by the figure now   *
+ * POST: the ranges contain the field, which spans x = [1, cols] and       *
+ *       y = [1, rows] (and z = [min, max] for surfaces)                   */
+MglFieldPlot& Figure::field(MglSubmissions::Ticket ticket, MglFieldPlot* plot)
+{
+  submit(std::move(ticket), plot, false);
+  return *plot;
+}
+
+/* add a plot to the plot queue                                              *
+ * PRE : plot has been allocated with new, it is owned by the figure now.   *
+ *       ticket has been drawn from submissions_ for this plot              *
+ * POST: the plot is submitted, and added at once unless plots are          *
+ *       submitted concurrently (see setConcurrent()). If lineStyle is true *
+ *       the plot gets the next style of the style-deque if it has none,    *
+ *       otherwise its style is removed from the deque                      */
+MglPlot& Figure::submit(MglSubmissions::Ticket ticket, MglPlot* plot, const bool lineStyle)
+{
+  ticket.submit(plot, lineStyle, std::pair<std::string, std::string>());
+  if (!concurrent_) {
+    collect();
+  }
+  return *plot;
+}
+
+/* add the submitted plots and labels                                       *
+ * PRE : not called concurrently with itself or other changes of the figure *
+ * POST: the plots and labels submitted so far are in plots_ and            *
+ *       additionalLabels_ in ticket order, with their styles assigned and  *
+ *       the ranges widened to them. Entries waiting for an earlier ticket  *
+ *       follow at a later call                                             */
+void Figure::collect()
+{
+  std::vector<std::unique_ptr<MglSubmissions::Entry> > entries = submissions_.take();
+  for (auto& entry : entries) {
+    if (!entry->plot) {
+      additionalLabels_.push_back(entry->label);
+      continue;
+    }
+
+    MglPlot& plot = *entry->plot;
+    if (entry->lineStyle) {
+      if (plot.get_style().empty()) {
+        plot.style(styles_.get_next());
+      }
+      else {
+        styles_.eliminate(plot.get_style());
+      }
+    }
+    if (plot.is_3d()) {
+      has_3d_ = true; // needed to set zranges in save-function and call mgl::Rotate
+    }
+    plots_.push_back(std::move(entry->plot));
+    // widen the ranges to the new data
+    setRanges(plot);
   }
 
-  // put the plot in the plot queue 
-  plots_.emplace_back(std::unique_ptr<MglFPlot>(new MglFPlot(function, style)));
-  return *plots_.back().get();
+  if (memoryBudget_ > 0 && !entries.empty()) {
+    reduceData(nullptr);
+  }
 }
 
 /* set ranges                                                   *
@@ -210,104 +520,135 @@ void Figure::ranges(const double& xMin, const double& xMax, const double& yMin,
   ranges_ = {xMin, xMax, yMin, yMax};
 }
 
-/* get minimal positive ( > 0 ) value of mglData                            *
- * PRE : -                                                                  *
- * POST: minimal positive value of argument,                                *
- *       std::numeric_limits<double>::max() if no positive value cotained,  *
- *       print a warning to std::cerr if a value <= 0 encountered           *
- * NOTE: this function is only used to check ranges in logarithmic scaling  * 
- *       therefore the warning                                              */
-double minPositive(const mglData& d)
+/* change ranges of plot                                                             *
+ * PRE : -                                                                           *
+ * POST: the automatic ranges are widened so that all data is displayed, with a      *
+ *       margin of vertMargin times the y extent on linear y axes                    *
+ * NOTE: kept for callers of the old interface, plots widen the ranges by their      *
+ *       cached extent, see setRanges(const MglPlot&). Ranges widened here are       *
+ *       dropped when the ranges are recomputed after plots are removed or replaced  */
+void Figure::setRanges(const mglData& xd, const mglData& yd, double vertMargin)
 {
-  double result = std::numeric_limits<double>::max();
-  bool print_warning = false;
-
-  // iterate over the given data
-  for (long i = 0; i < d.GetNx(); ++i){
-    if (d.a[i] > 0){
-      // if the data point is positive, check if it is smaller than the current minimum
-      result = std::min(result, d.a[i]);
-    }
-    else {
-      // if the data point is not positive it will not appear on the plot -> print warning
-      print_warning = true;
-    }
+  std::array<MglRange, 3> extent = {{ data_range(xd), data_range(yd), empty_range() }};
+  // adding a slight margin in linear plots on bottom and top
+  if (yFunc_ != "lg(y)" && !extent[1].empty()) {
+    const double yTot = extent[1].max - extent[1].min;
+    extent[1].min -= yTot*vertMargin;
+    extent[1].max += yTot*vertMargin;
   }
+  widenRanges(extent, true);
+}
 
-  if (print_warning) {
-    std::cerr << "* Figure - Warning * non-positive values of data will not appear on plot. \n";
-  }
+/* change ranges of the plotted region in 3d                        *
+ * PRE : -                                                          *
+ * POST: the ranges are widened so that all data will be visible   */
+void Figure::setRanges(const mglData& xd, const mglData& yd, const mglData& zd)
+{
+  widenRanges({{ data_range(xd), data_range(yd), data_range(zd) }}, true);
+}
 
-  return result;
+/* widen the ranges to the data of a plot                                          *
+ * PRE : -                                                                         *
+ * POST: see widenRanges(), for the extent of plot                                 *
+ * NOTE: uses the extent cached by the plot, the data are not looked at again      */
+void Figure::setRanges(const MglPlot& plot, const bool warn)
+{
+  widenRanges({{ plot.extent(0), plot.extent(1), plot.extent(2) }}, warn);
 }
 
-/* change ranges of plot                                                             *
- * PRE : -                                                                           *
- * POST: set ranges in such a way that all data is displayed                         *
- * NOTE: need the argument vertMargin to be able to set it to 0 when plotting in 3d  */
-void Figure::setRanges(const mglData& xd, const mglData& yd, double vertMargin)
+/* widen the ranges to an extent                                                   *
+ * PRE : -                                                                         *
+ * POST: the x and y ranges (if they are automatic) and the z range cover the      *
+ *       extent, on log scaled axes starting at the smallest positive value. With  *
+ *       'warn' data that won't appear on log scaled axes are reported             */
+void Figure::widenRanges(const std::array<MglRange, 3>& extent, const bool warn)
 {
-#if NDEBUG
-  std::cout << "setRanges for 2dim called\n";
-#endif
+  const bool logscaled[3] = { xFunc_ == "lg(x)", yFunc_ == "lg(y)", zFunc_ == "lg(z)" };
+  const char names[3] = { 'x', 'y', 'z' };
+  double* ranges[3] = { &ranges_[0], &ranges_[2], &zranges_[0] };
 
-  // initialize data
-  double xMax(xd.Maximal()), yMax(yd.Maximal());
-  double xMin(xd.Minimal()), yMin(yd.Minimal());
+  for (int axis = 0; axis < 3; ++axis) {
+    const MglRange& r = extent[axis];
+    // z ranges are always automatic
+    if (r.empty() || (axis < 2 && !autoRanges_)) {
+      continue;
+    }
 
-  // check for x and y axis if they are logarithmic,
-  // if yes: if the minimal value is <= 0 set xMin (or yMin) to the smallest positive number in the data
-  //         and if the maximal value is <= 0 no data will appear -> error message!
-  // if no:  leave the old value
-  if (xFunc_ == "lg(x)"){
-    if (xMax <= 0){
-      std::cerr << "In function Figure::setRanges() : Invalid ranges for logscaled plot - maximal x-value must be greater than 0.";
+    // if the axis is logarithmic the smallest positive value is the lower bound,
+    // if the maximal value is <= 0 no data will appear -> error message!
+    double lo = r.min;
+    if (logscaled[axis]) {
+      if (warn && r.max <= 0) {
+        std::cerr << "In function Figure::setRanges() : Invalid ranges for logscaled plot - maximal "
+                  << names[axis] << "-value must be greater than 0.";
+      }
+      // the pretransform counts these, see setLogTransform()
+      if (warn && r.min <= 0 && !logTransform_) {
+        std::cerr << "* Figure - Warning * non-positive values of data will not appear on plot. \n";
+      }
+      lo = std::min(r.minPositive, r.max);
     }
-    yMin = minPositive(xd);
+
+    ranges[axis][0] = std::min(lo, ranges[axis][0]);
+    ranges[axis][1] = std::max(r.max, ranges[axis][1]);
   }
-  if (yFunc_ == "lg(y)"){
-    if (yMax <= 0){
-      std::cerr << "In function Figure::setRanges() : Invalid ranges for logscaled plot - maximal y-value must be greater than 0.";
-    }
-    vertMargin = 0.; // no vertical margin in logscaling yet
-    yMin = minPositive(yd);
+}
+
+/* recompute the ranges from the plots                                       *
+ * PRE : -                                                                   *
+ * POST: automatic ranges cover exactly the data of the current plots, e.g.  *
+ *       after plots have been removed or their data replaced                *
+ * NOTE: O(number of plots), the plots cache the extent of their data        */
+void Figure::updateRanges()
+{
+  const double max = std::numeric_limits<double>::max(),
+               lowest = std::numeric_limits<double>::lowest();
+  if (autoRanges_) {
+    ranges_ = {max, lowest, max, lowest};
   }
+  zranges_ = {max, lowest};
 
-  // set new ranges
-  const double yTot = yMax - yMin;
-  ranges_[0] = std::min(xMin , ranges_[0]);
-  ranges_[1] = std::max(xMax , ranges_[1]);
-  ranges_[2] = std::min(yMin - yTot*vertMargin, ranges_[2]); // adding a slight margin in linear plots on bottom
-  ranges_[3] = std::max(yMax + yTot*vertMargin, ranges_[3]); // .. and top
+  has_3d_ = false;
+  for (auto& p : plots_) {
+    has_3d_ = has_3d_ || p->is_3d();
+    setRanges(*p, false);
+  }
 }
 
-/* change ranges of the plotted region in 3d                        *
- * PRE : -                                                          *
- * POST: set the ranges in such a way that all data will be visible */
-void Figure::setRanges(const mglData& xd, const mglData& yd, const mglData& zd)
+/* recompute the ranges if the data of a plot have been replaced         *
+ * PRE : -                                                               *
+ * POST: see updateRanges(), otherwise the ranges are kept as they are   */
+void Figure::refreshRanges()
 {
-#if NDEBUG
-  std::cout << "setRanges for 3dim called\n";
-#endif
-  // initializing data
-  const double zMax(zd.Maximal());
-  double zMin(zd.Minimal());
-
-  // check if z-axis is logarithmic,
-  // if yes: if the minimal value is <= 0 set zMin to the smallest positive number in the data
-  //         and if the maximal value is <= 0 no data will appear -> error message!
-  // if no:  leave the old value
-  if (zFunc_ == "lg(z)"){
-    if (zMax <= 0){
-      std::cerr << "In function Figure::setRanges() : Invalid ranges for logscaled plot - maximal z-value must be greater than 0.";
-    }
-    zMin = minPositive(zd);
+  bool changed = false;
+  for (auto& p : plots_) {
+    changed = changed || p->extent_changed();
+    p->set_extent_changed(false);
+  }
+  if (changed) {
+    updateRanges();
   }
-  zranges_[0] = std::min(zranges_[0], zMin);
-  zranges_[1] = std::max(zranges_[1], zMax);
-  setRanges(xd, yd, 0.); // use this function to set the correct x and y ranges
 }
 
+/* remove a plot                                                        *
+ * PRE : -                                                              *
+ * POST: the plot is deleted and the automatic ranges shrink to the     *
+ *       remaining plots. Returns false if plot is not in this figure   */
+bool Figure::remove(const MglPlot& plot)
+{
+  collect();
+  auto it = std::find_if(plots_.begin(), plots_.end(),
+                         [&](const std::unique_ptr<MglPlot>& p) { return p.get() == &plot; });
+  if (it == plots_.end()) {
+    std::cerr << "In function Figure::remove(): The plot is not part of this figure!";
+    return false;
+  }
+
+  plots_.erase(it);
+  cache_.reset(); // the removed plot may be on it
+  updateRanges();
+  return true;
+}
 
 /* (un-)set logscaling                                                               *
  * PRE : -                                                                           *
@@ -334,12 +675,39 @@ void Figure::title(const std::string& text)
   title_ = "@{" + text + "}";
 }
 
-/* save figure                                                              *
+/* compute the size of the graphic and the margins                           *
+ * PRE : -                                                                   *
+ * POST: figWidth_, figHeight_, topMargin_ and leftMargin_ are set according *
+ *       to the plot size, if they haven't been set manually                 */
+void Figure::layout() {
+  collect();
+  refreshRanges();
+
+  // check if the plot, fig and top/left margins havent been set manually
+  if (figWidth_ == -1 || figHeight_ == -1 || topMargin_ == -1 || leftMargin_ == -1) {
+    // means there is a label
+    if (yMglLabel_.str_.size() != 0 || xMglLabel_.str_.size() != 0) {
+      figWidth_ = plotWidth_ + 300;
+      figHeight_ = plotHeight_ + 270;
+      topMargin_ = 100; // leave sufficient space for the labels
+      leftMargin_ = 150;
+    }
+    else {
+      figWidth_ = plotWidth_ + 200;
+      figHeight_ = plotHeight_ + 200;
+      topMargin_ = 100; // just a small margin, space for axis ticks
+      leftMargin_ = 100;
+    }
+  }
+}
+
+/* prepare a graph for plotting                                             *
  * PRE : -                                                                  *
- * POST: write figure to 'file' in png-format if 'file' end on .png,        *
- *       and to eps-format otherwise                                        *
+ * POST: gr has the given size, the tick settings and the fonts. If 'rows'   *
+ *       is in (0, height) gr only holds the band of image rows             *
+ *       [top, top + rows) of the width x height graphic                     *
  * ! IMPORTANT NOTE !                                                       *
- * The methods on gr_ have to be called in a particular order:              *
+ * The methods on gr have to be called in a particular order:               *
  *  1. SetSize - first to be called as it deletes all content               *
  *  2. Set Ticks & Font (SetTuneTicks, SetTickLen, LoadFont, SetFontSizePT) *
  *              2d-plot                     3d-plot                         *
@@ -356,95 +724,210 @@ void Figure::title(const std::string& text)
  *  12. AddLegend                        finally: WriteEPS/PNG              *
  *  13. Legend                                                              *
  *  finally: WriteEPS/PNG                                                   *
- * If this order is violated the layout may change drastically!             */
-void Figure::save(const std::string& file) {
-  mglGraph gr_; // graph in which the plots will be saved
-
-  // check if the plot, fig and top/left margins havent been set manually
-  if (figWidth_ == -1 || figHeight_ == -1 || topMargin_ == -1 || leftMargin_ == -1) {
-    // means there is a label
-    if (yMglLabel_.str_.size() != 0 || xMglLabel_.str_.size() != 0) {
-      figWidth_ = plotWidth_ + 300;
-      figHeight_ = plotHeight_ + 270;
-      topMargin_ = 100; // leave sufficient space for the labels
-      leftMargin_ = 150;
-    }
-    else {
-      figWidth_ = plotWidth_ + 200;
-      figHeight_ = plotHeight_ + 200;
-      topMargin_ = 100; // just a small margin, space for axis ticks
-      leftMargin_ = 100;
-    }
+ * If this order is violated the layout may change drastically!             *
+ * Steps 1 and 2 are done here, the rest in place(), drawPlots() and        *
+ * drawLegend().                                                            */
+void Figure::prepare(mglGraph& gr, const int width, const int height, const int top, const int rows) {
+  // Set size. This *must* be the first function called on the mglGraph
+  const bool band = (rows > 0 && rows < height);
+  gr.SetSize(width, band ? rows : height);
+  if (band) {
+    // the whole graphic is scaled so that only the band is on the canvas,
+    // every band shares the transform of the full size graphic
+    gr.Zoom(0, 1 - double(top + rows)/height, 1, 1 - double(top)/height);
   }
 
-  // Set size. This *must* be the first function called on the mglGraph
-  gr_.SetSize(figWidth_, figHeight_);
+  gr.SetQuality(mglQuality());
 
-  // Set position of scale annotations
-  gr_.SetTuneTicks(true, 1.04);
+  // Set position of scale annotations, previews skip the tuning of the tick labels
+  gr.SetTuneTicks(quality_ != Quality::Preview, 1.04);
   // Shorten tick marks (factor 0.01) and make subticks so small that they do not appear (factor 1000)
-  gr_.SetTickLen(0.01, 1000); 
+  gr.SetTickLen(0.01, 1000); 
 
   // set font to 'heros'. If the file is not available on the machine it will use the MathGL default (STIX)
-  gr_.LoadFont("heros");
+  // previews use the built-in default font to save copying the font
+  if (quality_ != Quality::Preview) {
+    gr.CopyFont(&fontGraph());
+  }
+}
+
+/* MathGL draw mode for the quality setting                                 *
+ * PRE : -                                                                  *
+ * POST: returns the MGL_DRAW_* flags to pass to mglGraph::SetQuality       */
+int Figure::mglQuality() const {
+  int quality = MGL_DRAW_NORM;
+  switch (quality_) {
+    case Quality::Preview:
+      // no antialiasing, raster formats are drawn directly into the bitmap
+      // without storing primitives (vector formats are written from them)
+      quality = vectorSave_ ? MGL_DRAW_FAST : MGL_DRAW_FAST | MGL_DRAW_LMEM;
+      break;
+    case Quality::Normal:
+      quality = MGL_DRAW_NORM;
+      break;
+    case Quality::Publication:
+      quality = MGL_DRAW_HIGH;
+      break;
+  }
+
+  // layers are composited pixel-wise, which needs the canvases to draw
+  // directly into their buffers instead of storing the primitives. Vector
+  // formats are written from the primitives, so they are drawn on one canvas
+  if (layers_ > 1 && !vectorSave_) {
+    quality |= MGL_DRAW_LMEM;
+  }
+  // the stored primitives are the largest part of a save with many points
+  if (lowMemory_ && !vectorSave_) {
+    quality |= MGL_DRAW_LMEM;
+  }
+  return quality;
+}
+
+/* place this figure in cell 'idx' of a rows x cols grid on gr              *
+ * PRE : layout() has been called, gr has been prepared with prepare()      *
+ * POST: gr has the ranges and the coordinate transform of this figure.     *
+ *       If decorate is true title, labels, grid, axis and box are drawn    *
+ *       as well, otherwise only what is needed for the transform           */
+void Figure::place(mglGraph& gr, const int rows, const int cols, const int idx, bool decorate) {
   // set the font size
-  gr_.SetFontSizePT(fontSizePT_);
+  gr.SetFontSizePT(fontSizePT_);
 
   // Set ranges and call rotate if necessary (to set the correct point of view)
   if (has_3d_){
     // when plotting 3d we do need all the margins and we cannot cut them off 
-    // -> cannot call gr_.SubPlot(1,1,0,"<_") or similar here!
-    gr_.SetRanges(ranges_[0], ranges_[1], ranges_[2], ranges_[3], zranges_[0], zranges_[1]);
-    gr_.Rotate(60, 30);
+    // -> cannot call gr.SubPlot(1,1,0,"<_") or similar here!
+    if (rows*cols > 1) {
+      gr.SubPlot(cols, rows, idx);
+    }
+    gr.SetRanges(ranges_[0], ranges_[1], ranges_[2], ranges_[3], zranges_[0], zranges_[1]);
+    gr.Rotate(view_[0], view_[1]);
+  }
+  else if (logData_[0] || logData_[1]) {
+    // the axes are linear in log10 units, see pretransform()
+    gr.SubPlot(cols, rows, idx, "#");
+    gr.SetRanges(logData_[0] ? std::log10(ranges_[0]) : ranges_[0], logData_[0] ? std::log10(ranges_[1]) : ranges_[1],
+                 logData_[1] ? std::log10(ranges_[2]) : ranges_[2], logData_[1] ? std::log10(ranges_[3]) : ranges_[3]);
   }
   else {
-    gr_.SubPlot(1, 1, 0, "#"); 
-    gr_.SetRanges(ranges_[0], ranges_[1], ranges_[2], ranges_[3]);
+    gr.SubPlot(cols, rows, idx, "#"); 
+    gr.SetRanges(ranges_[0], ranges_[1], ranges_[2], ranges_[3]);
   }
 
-
-  // Add title
+  // Add title. If not decorating a blank title is used instead, as the
+  // title shrinks the plot region by its height independent of its text
   if (title_.size() != 0){
-    gr_.Title(title_.c_str());
+    gr.Title(decorate ? title_.c_str() : " ");
   }
 
   // use InPlot to force having a quadratic plot-window
   if (!has_3d_) {
-    gr_.InPlot( double(leftMargin_) / figWidth_, // margin from left
-                double(leftMargin_ + plotWidth_) / figWidth_, // how far to the right
-                double(figHeight_ - plotHeight_ - topMargin_) / figHeight_, // how far to the bottom
-                double(figHeight_ - topMargin_) / figHeight_ ); // how far up
+    gr.InPlot( double(leftMargin_) / figWidth_, // margin from left
+               double(leftMargin_ + plotWidth_) / figWidth_, // how far to the right
+               double(figHeight_ - plotHeight_ - topMargin_) / figHeight_, // how far to the bottom
+               double(figHeight_ - topMargin_) / figHeight_ ); // how far up
     // Set aspects: 1, 1, 1 will give a normal plot. (default)
     //              1,-1, 1 will invert the y axis. (used for spy plots)
     // Note: This *has* to be called after SubPlot and InPlot, otherwise the axis labels will be in 1,1,1 manner
-    gr_.Aspect(aspects_[0], aspects_[1], aspects_[2]);
+    gr.Aspect(aspects_[0], aspects_[1], aspects_[2]);
   }
 
   // Set label - before setting curvilinear because MathGL is vulnerable to errors otherwise
-  gr_.Label('x', xMglLabel_.str_.c_str(), xMglLabel_.pos_);
-  gr_.Label('y', yMglLabel_.str_.c_str(), yMglLabel_.pos_);
+  if (decorate) {
+    gr.Label('x', xMglLabel_.str_.c_str(), xMglLabel_.pos_);
+    gr.Label('y', yMglLabel_.str_.c_str(), yMglLabel_.pos_);
+  }
 
-  // Set Curvilinear functions
-  gr_.SetFunc(xFunc_.c_str(), yFunc_.c_str(), zFunc_.c_str());
+  // Set Curvilinear functions, pretransformed axes are linear with log labels.
+  // Ticks set by another panel on the same graph are reset
+  gr.SetFunc(logData_[0] ? "" : xFunc_.c_str(), logData_[1] ? "" : yFunc_.c_str(), zFunc_.c_str());
+  const char axes[2] = { 'x', 'y' };
+  for (int axis = 0; axis < 2; ++axis) {
+    if (logData_[axis]) {
+      log_ticks(gr, axes[axis], std::log10(ranges_[2*axis]), std::log10(ranges_[2*axis + 1]));
+    }
+    else {
+      gr.SetTicks(axes[axis]);
+    }
+  }
+
+  if (!decorate) {
+    return;
+  }
 
   // Add grid
   if (grid_){
-    gr_.Grid(gridType_.c_str() , gridCol_.c_str());
+    gr.Grid(gridType_.c_str() , gridCol_.c_str());
   }
 
   // Add axis
   if (axis_){
-    gr_.Axis();
+    gr.Axis();
   }
 
-  gr_.Box();
-  // Plot
+  gr.Box();
+}
+
+/* draw all plots of this figure                                *
+ * PRE : gr has been set up with place() for this figure,        *
+ *       slot < arenas_.size() is not used by another thread     *
+ * POST: all plots are drawn, in the order they have been added, *
+ *       with the scratch memory of arena 'slot'                 */
+void Figure::drawPlots(mglGraph& gr, const unsigned slot) {
+  MglRenderContext ctx = renderContext(slot);
   for(auto &p : plots_) {
-    p->plot(&gr_);
+    p->plot(&gr, ctx);
+  }
+}
+
+/* state for rendering the plots of this figure                              *
+ * PRE : slot < arenas_.size(), see reserveArenas()                          *
+ * POST: returns a context with the ranges of the figure, taking its scratch *
+ *       memory from arena 'slot'. If the ranges have been set by the user   *
+ *       the plots clip their data to them, as most of the data may be       *
+ *       off-screen                                                          */
+MglRenderContext Figure::renderContext(const unsigned slot) const {
+  MglRenderContext ctx(*arenas_[slot]);
+  ctx.clip_ = !autoRanges_;
+  ctx.ranges_ = ranges_;
+  ctx.zranges_ = zranges_;
+  // 3d plots are not placed with InPlot, they may use the whole graphic
+  ctx.width_ = has_3d_ ? figWidth_ : plotWidth_;
+  ctx.height_ = has_3d_ ? figHeight_ : plotHeight_;
+  // sub-pixel details of 3d lines are not visible, see MglPlot3d
+  ctx.tolerance_ = 0.5;
+  ctx.view_ = view_;
+  ctx.lineTolerance_ = lineTolerance_;
+  ctx.logx_ = (xFunc_ == "lg(x)");
+  ctx.logy_ = (yFunc_ == "lg(y)");
+  // on pretransformed axes the plots draw in log10 units on linear axes
+  for (int axis = 0; axis < 2; ++axis) {
+    if (logData_[axis]) {
+      ctx.ranges_[2*axis] = std::log10(ranges_[2*axis]);
+      ctx.ranges_[2*axis + 1] = std::log10(ranges_[2*axis + 1]);
+    }
+  }
+  ctx.logx_ = ctx.logx_ && !logData_[0];
+  ctx.logy_ = ctx.logy_ && !logData_[1];
+  ctx.logData_ = logData_;
+  return ctx;
+}
+
+/* draw the legend of this figure                                *
+ * PRE : gr has been set up with place() for this figure         *
+ * POST: the legend entries are added and if legend_ is set the  *
+ *       legend is drawn                                         */
+void Figure::drawLegend(mglGraph& gr) {
+  // entries of other panels on the same graph must not show up here
+  gr.ClearLegend();
+
+  // legend entries are added once all plots are drawn, so they are
+  // the same for sequential and layered rendering
+  for(auto &p : plots_) {
+    p->legend(&gr);
   }
 
   for (auto s : additionalLabels_) {
-    gr_.AddLegend(s.first.c_str(), s.second.c_str());
+    gr.AddLegend(s.first.c_str(), s.second.c_str());
   }
 
   // Add legend
@@ -460,28 +943,1115 @@ void Figure::save(const std::string& file) {
 
       double newxPos = (1 - 2*bx) * legendPos_.first + bx,
              newyPos = (1 - 2*by) * legendPos_.second + by;
-      gr_.Legend(newxPos, newyPos);
+      gr.Legend(newxPos, newyPos);
+    }
+    else {
+      gr.Legend(legendPos_.first, legendPos_.second);
+    }
+  }
+}
+
+/* scratch memory for n threads drawing plots of this figure at a time      *
+ * PRE : not called while plots are drawn                                   *
+ * POST: arenas_ has at least n arenas. They belong to the figure, not to   *
+ *       the threads, so their blocks are kept from one save to the next    *
+ *       although parallel_chunks() starts new threads for every save       */
+void Figure::reserveArenas(const std::size_t n) {
+  while (arenas_.size() < n) {
+    arenas_.emplace_back(new MglArena);
+  }
+}
+
+/* drop the scratch memory of the last render pass                          *
+ * PRE : no plot of this figure or its panels is drawn                      *
+ * POST: the arenas of the figure and its panels are released, with their  *
+ *       counters, the blocks are kept                                      */
+void Figure::releaseArenas() {
+  for (auto& a : arenas_) {
+    a->release();
+  }
+  for (auto& panel : panels_) {
+    if (panel) {
+      panel->releaseArenas();
+    }
+  }
+}
+
+/* allocations of the arenas of this figure and its panels since they have  *
+ * been released, other figures are not counted                             */
+MglArenaStats Figure::arenaStats() const {
+  MglArenaStats total{ 0, 0, 0 };
+  for (auto& a : arenas_) {
+    const MglArenaStats s = a->stats();
+    total.requests += s.requests;
+    total.heapAllocations += s.heapAllocations;
+    total.bytes += s.bytes;
+  }
+  for (auto& panel : panels_) {
+    if (panel) {
+      const MglArenaStats s = panel->arenaStats();
+      total.requests += s.requests;
+      total.heapAllocations += s.heapAllocations;
+      total.bytes += s.bytes;
+    }
+  }
+  return total;
+}
+
+/* rasterize the plots on separate canvases in parallel and composite them *
+ * PRE : gr has been set up with place() for this figure, layers_ > 1      *
+ * POST: all plots are drawn on gr, in the order they have been added       */
+void Figure::renderLayers(mglGraph& gr) {
+  const std::size_t n = plots_.size();
+  const unsigned layers = unsigned(std::min<std::size_t>(layers_, n));
+
+  // the canvases are prepared sequentially, as MathGL loads its fonts into
+  // shared state. They get the same transform as gr but no decorations
+  reserveArenas(layers);
+  std::vector<std::unique_ptr<mglGraph> > canvases(layers);
+  for (auto& c : canvases) {
+    c.reset(new mglGraph);
+    prepare(*c, figWidth_, figHeight_);
+    place(*c, 1, 1, 0, false);
+  }
+
+  // every layer takes a contiguous group of plots, so compositing the
+  // layers in order keeps the plot order
+  parallel_chunks(n, layers, [&](std::size_t begin, std::size_t end, unsigned k) {
+    MglRenderContext ctx = renderContext(k); // scratch memory is per thread
+    for (std::size_t i = begin; i < end; ++i) {
+      plots_[i]->plot(canvases[k].get(), ctx);
+    }
+    canvases[k]->Finish();
+  });
+
+  for (auto& c : canvases) {
+    gr.Combine(c.get());
+  }
+}
+
+/* get a panel of a grid of rows x cols subplots                              *
+ * PRE : 0 <= idx < rows*cols, the panels are numbered row by row             *
+ * POST: returns the figure of panel idx, which is created if needed. It has  *
+ *       its own ranges, labels, scaling and plots and will be drawn in its   *
+ *       cell when this figure is saved                                       */
+Figure& Figure::subplot(const int rows, const int cols, int idx)
+{
+  if (rows < 1 || cols < 1) {
+    std::cerr << "In function Figure::subplot(): rows and cols must be positive!";
+    return *this;
+  }
+
+  // changing the grid layout starts a new grid
+  if (rows != rows_ || cols != cols_) {
+    if (!panels_.empty()) {
+      std::cerr << "* Figure - Warning * subplot grid changed, previous panels are dropped\n";
+    }
+    rows_ = rows;
+    cols_ = cols;
+    panels_.clear();
+    panels_.resize(rows*cols);
+  }
+
+  if (idx < 0 || idx >= rows*cols) {
+    std::cerr << "In function Figure::subplot(): idx must be in [0, rows*cols)!";
+    idx = std::max(0, std::min(idx, rows*cols - 1));
+  }
+
+  if (!panels_[idx]) {
+    panels_[idx].reset(new Figure);
+  }
+  return *panels_[idx];
+}
+
+/* size of a subplot grid                                                *
+ * PRE : panels_ is not empty                                            *
+ * POST: the panels are laid out, all cells have the size of the largest *
+ *       panel and figWidth_, figHeight_ are the size of the grid        */
+void Figure::layoutPanels() {
+  if (!plots_.empty()) {
+    std::cerr << "* Figure - Warning * plots of a figure with subplots are not drawn, add them to a panel\n";
+  }
+
+  int cellWidth = 0, cellHeight = 0;
+  for (auto& p : panels_) {
+    if (p) {
+      p->layout();
+      cellWidth = std::max(cellWidth, p->figWidth_);
+      cellHeight = std::max(cellHeight, p->figHeight_);
+    }
+  }
+  figWidth_ = cols_*cellWidth;
+  figHeight_ = rows_*cellHeight;
+}
+
+/* draw all panels of the subplot grid on gr                             *
+ * PRE : layoutPanels() has been called                                  *
+ * POST: gr is prepared (for the band [top, top + rows), see prepare())  *
+ *       and every panel is drawn in its cell, the panels are rasterized *
+ *       in parallel if 'layered' and layers_ > 1                        */
+void Figure::renderPanels(mglGraph& gr, const int top, const int rows, const bool layered) {
+  prepare(gr, figWidth_, figHeight_, top, rows);
+
+  if (!layered || layers_ <= 1) {
+    for (std::size_t idx = 0; idx < panels_.size(); ++idx) {
+      if (panels_[idx]) {
+        panels_[idx]->place(gr, rows_, cols_, int(idx), true);
+        panels_[idx]->drawPlots(gr);
+        panels_[idx]->drawLegend(gr);
+      }
+    }
+    return;
+  }
+
+  // decorations are drawn sequentially on gr, the plots of every panel
+  // are rasterized on a canvas of their own
+  std::vector<std::unique_ptr<mglGraph> > canvases(panels_.size());
+  for (std::size_t idx = 0; idx < panels_.size(); ++idx) {
+    if (panels_[idx]) {
+      panels_[idx]->place(gr, rows_, cols_, int(idx), true);
+      canvases[idx].reset(new mglGraph);
+      prepare(*canvases[idx], figWidth_, figHeight_);
+      panels_[idx]->place(*canvases[idx], rows_, cols_, int(idx), false);
+    }
+  }
+
+  parallel_chunks(panels_.size(), unsigned(std::min<std::size_t>(layers_, panels_.size())),
+    [&](std::size_t begin, std::size_t end, unsigned) {
+      for (std::size_t idx = begin; idx < end; ++idx) {
+        if (panels_[idx]) {
+          panels_[idx]->drawPlots(*canvases[idx]);
+          canvases[idx]->Finish();
+        }
+      }
+    });
+
+  // composite in panel order and add the legends on top
+  for (std::size_t idx = 0; idx < panels_.size(); ++idx) {
+    if (panels_[idx]) {
+      gr.Combine(canvases[idx].get());
+    }
+  }
+  for (std::size_t idx = 0; idx < panels_.size(); ++idx) {
+    if (panels_[idx]) {
+      panels_[idx]->place(gr, rows_, cols_, int(idx), false);
+      panels_[idx]->drawLegend(gr);
+    }
+  }
+}
+
+/* start an animation                                                       *
+ * PRE : -                                                                  *
+ * POST: every call of frame() adds the current state of the figure as a    *
+ *       frame to 'file'. If 'file' ends on .gif an animated GIF with 'fps'  *
+ *       frames per second is written, otherwise the frames are written as  *
+ *       raw RGBA data (row by row, top to bottom) to be piped into an      *
+ *       encoder. "-" writes the raw frames to stdout                       *
+ * NOTE: the size of the frames is fixed by the first call. Title, labels,  *
+ *       grid, axis and box are drawn once and redrawn only if the ranges   *
+ *       change, so only the plots cost time in every frame                 */
+void Figure::beginAnimation(const std::string& file, const int fps)
+{
+  if (animGraph_) {
+    endAnimation();
+  }
+  if (!panels_.empty()) {
+    std::cerr << "* Figure - Warning * animations of subplot grids are not supported\n";
+    return;
+  }
+
+  if (file.size() < 4 || file.compare(file.size() - 4, 4, ".gif") != 0) {
+    animStream_ = (file == "-") ? stdout : std::fopen(file.c_str(), "wb");
+    if (!animStream_) {
+      std::cerr << "In function Figure::beginAnimation(): Cannot open " << file << "!";
+      return;
+    }
+  }
+
+  layout();
+
+  // the graph is set up once, every frame only redoes the transform
+  animGraph_.reset(new mglGraph);
+  prepare(*animGraph_, figWidth_, figHeight_);
+  // the background is composited pixel-wise into every frame
+  animGraph_->SetQuality(mglQuality() | MGL_DRAW_LMEM);
+  animBackground_.reset();
+
+  if (!animStream_) {
+    animGraph_->StartGIF(file.c_str(), 1000/std::max(1, fps));
+  }
+}
+
+/* add a frame to the animation                                  *
+ * PRE : beginAnimation() has been called                        *
+ * POST: the current state of the figure is added as a new frame */
+void Figure::frame()
+{
+  if (!animGraph_) {
+    std::cerr << "In function Figure::frame(): No animation running, call beginAnimation() first!";
+    return;
+  }
+  mglGraph& gr = *animGraph_;
+  collect();
+  refreshRanges();
+
+  // redraw the static layers only if the ranges have changed
+  const std::array<double, 6> ranges = {ranges_[0], ranges_[1], ranges_[2], ranges_[3], zranges_[0], zranges_[1]};
+  if (!animBackground_ || ranges != animRanges_) {
+    animBackground_.reset(new mglGraph);
+    prepare(*animBackground_, figWidth_, figHeight_);
+    animBackground_->SetQuality(mglQuality() | MGL_DRAW_LMEM);
+    place(*animBackground_, 1, 1, 0, true);
+    animBackground_->Finish();
+    animRanges_ = ranges;
+  }
+
+  if (animStream_) {
+    gr.Clf();
+  }
+  else {
+    gr.NewFrame();
+  }
+  place(gr, 1, 1, 0, false);
+  gr.Combine(animBackground_.get());
+  drawPlots(gr);
+  drawLegend(gr);
+
+  if (animStream_) {
+    gr.Finish();
+    std::fwrite(gr.GetRGBA(), 4, std::size_t(figWidth_)*figHeight_, animStream_);
+  }
+  else {
+    gr.EndFrame();
+  }
+  releaseArenas();
+}
+
+/* finish the animation                                         *
+ * PRE : -                                                      *
+ * POST: the animation file is closed, frame() has no effect    */
+void Figure::endAnimation()
+{
+  if (animStream_) {
+    if (animStream_ == stdout) {
+      std::fflush(stdout);
     }
     else {
-      gr_.Legend(legendPos_.first, legendPos_.second);
+      std::fclose(animStream_);
+    }
+    animStream_ = nullptr;
+  }
+  else if (animGraph_) {
+    animGraph_->CloseGIF();
+  }
+  animGraph_.reset();
+  animBackground_.reset();
+}
+
+/* remove all plots                                                       *
+ * PRE : -                                                                *
+ * POST: plots and manually added labels are removed and all styles are   *
+ *       available again, ranges and layout are kept (e.g. for animations) */
+void Figure::clearPlots()
+{
+  collect(); // plots submitted before are removed as well
+  plots_.clear();
+  cache_.reset(); // the removed plots may be on it
+  additionalLabels_.clear();
+  styles_ = MglStyle();
+}
+
+/* write the figure to a binary scene                                        *
+ * PRE : -                                                                   *
+ * POST: layout, settings, plots and panels are written to 'out' in the      *
+ *       format described in MglScene.hpp, returns false if writing failed.  *
+ *       deserialize() restores the figure, e.g. in another process, and     *
+ *       saving it gives the same output as saving this figure               */
+bool Figure::serialize(std::ostream& out)
+{
+  collect();
+  for (auto& panel : panels_) {
+    if (panel) {
+      panel->collect();
+    }
+  }
+  MglSceneWriter scene(out);
+  scene.header();
+  write(scene);
+  if (!scene.good()) {
+    std::cerr << "In function Figure::serialize(): Could not write the scene!";
+  }
+  return scene.good();
+}
+
+/* restore a figure written by serialize()                                  *
+ * PRE : -                                                                  *
+ * POST: the figure is replaced by the one in 'in'. Returns false if 'in'   *
+ *       is no scene, has a newer version or is damaged, then the plots     *
+ *       and panels of the figure are removed. Scenes of older versions are *
+ *       read with defaults for the settings they lack                      */
+bool Figure::deserialize(std::istream& in)
+{
+  MglSceneReader scene(in);
+  const std::uint32_t version = scene.header();
+  // older scenes are read with defaults for what they lack, see MglScene
+  if (scene.good() && (version == 0 || version > MglScene::version)) {
+    std::cerr << "In function Figure::deserialize(): Unknown scene version " << version << "!";
+    return false;
+  }
+  if (!read(scene)) {
+    std::cerr << "In function Figure::deserialize(): No scene or damaged scene!";
+    plots_.clear();
+    panels_.clear();
+    rows_ = cols_ = 0;
+    return false;
+  }
+  return true;
+}
+
+/* write the state of the figure, see serialize() */
+void Figure::write(MglSceneWriter& out) const
+{
+  out.u32(axis_);
+  out.u32(grid_);
+  out.u32(legend_);
+  out.f64(legendPos_.first);
+  out.f64(legendPos_.second);
+  out.str(gridType_);
+  out.str(gridCol_);
+  out.u32(has_3d_);
+  for (const double r : ranges_) {
+    out.f64(r);
+  }
+  for (const double r : zranges_) {
+    out.f64(r);
+  }
+  for (const double a : aspects_) {
+    out.f64(a);
+  }
+  for (const double v : view_) {
+    out.f64(v);
+  }
+  out.u32(autoRanges_);
+  out.str(title_);
+  out.str(xFunc_);
+  out.str(yFunc_);
+  out.str(zFunc_);
+  out.str(xMglLabel_.str_);
+  out.f64(xMglLabel_.pos_);
+  out.str(yMglLabel_.str_);
+  out.f64(yMglLabel_.pos_);
+  out.f64(fontSizePT_);
+  out.i32(figHeight_);
+  out.i32(figWidth_);
+  out.i32(plotHeight_);
+  out.i32(plotWidth_);
+  out.i32(leftMargin_);
+  out.i32(topMargin_);
+  out.u64(additionalLabels_.size());
+  for (auto& label : additionalLabels_) {
+    out.str(label.first);
+    out.str(label.second);
+  }
+  out.i32(layers_);
+  out.i32(tileHeight_);
+  out.u32(caching_);
+  out.u32(std::uint32_t(quality_));
+  out.u64(memoryBudget_);
+  out.u32(logTransform_);
+  out.u32(std::uint32_t(compression_));
+
+  out.u64(plots_.size());
+  for (auto& p : plots_) {
+    p->serialize(out);
+  }
+
+  out.i32(rows_);
+  out.i32(cols_);
+  out.u64(panels_.size());
+  for (auto& panel : panels_) {
+    out.u32(panel != nullptr);
+    if (panel) {
+      panel->write(out);
+    }
+  }
+}
+
+/* read the state of the figure, see deserialize()                 *
+ * POST: returns false if the scene is damaged                     */
+bool Figure::read(MglSceneReader& in)
+{
+  axis_ = in.u32() != 0;
+  grid_ = in.u32() != 0;
+  legend_ = in.u32() != 0;
+  legendPos_.first = in.f64();
+  legendPos_.second = in.f64();
+  gridType_ = in.str();
+  gridCol_ = in.str();
+  has_3d_ = in.u32() != 0;
+  for (double& r : ranges_) {
+    r = in.f64();
+  }
+  for (double& r : zranges_) {
+    r = in.f64();
+  }
+  for (double& a : aspects_) {
+    a = in.f64();
+  }
+  for (double& v : view_) {
+    v = in.f64();
+  }
+  autoRanges_ = in.u32() != 0;
+  title_ = in.str();
+  xFunc_ = in.str();
+  yFunc_ = in.str();
+  zFunc_ = in.str();
+  xMglLabel_.str_ = in.str();
+  xMglLabel_.pos_ = in.f64();
+  yMglLabel_.str_ = in.str();
+  yMglLabel_.pos_ = in.f64();
+  fontSizePT_ = in.f64();
+  figHeight_ = in.i32();
+  figWidth_ = in.i32();
+  plotHeight_ = in.i32();
+  plotWidth_ = in.i32();
+  leftMargin_ = in.i32();
+  topMargin_ = in.i32();
+  additionalLabels_.clear();
+  for (std::uint64_t k = in.u64(); k > 0 && in.good(); --k) {
+    const std::string label = in.str();
+    additionalLabels_.emplace_back(label, in.str());
+  }
+  layers_ = in.i32();
+  tileHeight_ = in.i32();
+  caching_ = in.u32() != 0;
+  const std::uint32_t quality = in.u32();
+  quality_ = in.check(quality <= std::uint32_t(Quality::Publication)) ? Quality(quality) : Quality::Normal;
+  // fields added after the first version, see MglScene
+  memoryBudget_ = in.version() >= 2 ? std::size_t(in.u64()) : 0;
+  logTransform_ = in.version() >= 3 ? in.u32() != 0 : false;
+  const std::uint32_t compression = in.version() >= 4 ? in.u32() : std::uint32_t(Compression::Default);
+  compression_ = in.check(compression <= std::uint32_t(Compression::Best)) ? Compression(compression) : Compression::Default;
+
+  collect(); // submitted plots are replaced as well
+  plots_.clear();
+  cache_.reset();
+  std::vector<std::string> used; // styles of the plots, not available for new plots
+  for (std::uint64_t k = in.u64(); k > 0 && in.good(); --k) {
+    std::unique_ptr<MglPlot> plot(read_plot(in));
+    if (plot && in.good()) {
+      used.push_back(plot->get_style());
+      plots_.push_back(std::move(plot));
+    }
+  }
+  styles_ = MglStyle(used);
+
+  rows_ = in.i32();
+  cols_ = in.i32();
+  panels_.clear();
+  for (std::uint64_t k = in.u64(); k > 0 && in.good(); --k) {
+    std::unique_ptr<Figure> panel;
+    if (in.u32() != 0) {
+      panel.reset(new Figure);
+      panel->read(in);
+    }
+    panels_.push_back(std::move(panel));
+  }
+  return in.good();
+}
+
+/* draw the figure on gr                                                    *
+ * PRE : layout() or layoutPanels() has been called                         *
+ * POST: gr is prepared and holds the whole graphic, or only the band of    *
+ *       image rows [top, top + rows) if rows is in (0, figHeight_). Plots   *
+ *       are rendered on layers_ canvases in parallel if 'layered'           */
+void Figure::render(mglGraph& gr, const int top, const int rows, const bool layered) {
+  if (!panels_.empty()) {
+    renderPanels(gr, top, rows, layered);
+    return;
+  }
+
+  prepare(gr, figWidth_, figHeight_, top, rows);
+  place(gr, 1, 1, 0, true);
+
+  // Plot
+  if (layered && layers_ > 1 && plots_.size() > 1) {
+    renderLayers(gr);
+  }
+  else {
+    drawPlots(gr);
+  }
+
+  drawLegend(gr);
+}
+
+/* everything that changes the background of the figure, as a string       *
+ * PRE : layout() has been called                                           *
+ * POST: if the key is equal for two saves the background is equal         */
+std::string Figure::layoutKey() const {
+  std::ostringstream key;
+  key.precision(17);
+  key << figWidth_ << ' ' << figHeight_ << ' ' << plotWidth_ << ' ' << plotHeight_ << ' '
+      << leftMargin_ << ' ' << topMargin_ << ' ' << fontSizePT_ << ' ' << int(quality_) << ' ';
+  for (const double r : ranges_) {
+    key << r << ' ';
+  }
+  for (const double r : zranges_) {
+    key << r << ' ';
+  }
+  for (const double a : aspects_) {
+    key << a << ' ';
+  }
+  for (const double v : view_) {
+    key << v << ' ';
+  }
+  key << autoRanges_ << has_3d_ << axis_ << grid_ << logData_[0] << logData_[1] << '\n'
+      << gridType_ << '\n' << gridCol_ << '\n' << title_ << '\n'
+      << xFunc_ << '\n' << yFunc_ << '\n' << zFunc_ << '\n'
+      << xMglLabel_.str_ << '\n' << xMglLabel_.pos_ << '\n'
+      << yMglLabel_.str_ << '\n' << yMglLabel_.pos_;
+  return key.str();
+}
+
+/* draw the figure on gr, reusing the background of the last save           *
+ * PRE : layout() has been called, no panels                                *
+ * POST: gr is prepared and holds the whole graphic. Plots that did not     *
+ *       change since the last save are moved to the cached background, so  *
+ *       a warm save costs the changed plots and the legend only            */
+void Figure::renderCached(mglGraph& gr) {
+  const std::string key = layoutKey();
+  bool rebuild = (!cache_ || key != cacheKey_);
+  for (auto& p : plots_) {
+    // a plot can't be taken off the raster of the background
+    rebuild = rebuild || (p->is_cached() && p->is_dirty());
+  }
+
+  if (rebuild) {
+    cache_.reset(new mglGraph);
+    prepare(*cache_, figWidth_, figHeight_);
+    cache_->SetQuality(mglQuality() | MGL_DRAW_LMEM);
+    place(*cache_, 1, 1, 0, true);
+    for (auto& p : plots_) {
+      p->set_cached(false);
+    }
+    cacheKey_ = key;
+  }
+
+  // plots unchanged since the last save go to the background, once
+  MglRenderContext ctx = renderContext();
+  for (auto& p : plots_) {
+    if (!p->is_cached() && !p->is_dirty()) {
+      p->plot(cache_.get(), ctx);
+      p->set_cached(true);
+    }
+  }
+  cache_->Finish();
+
+  prepare(gr, figWidth_, figHeight_);
+  gr.SetQuality(mglQuality() | MGL_DRAW_LMEM);
+  place(gr, 1, 1, 0, false);
+  gr.Combine(cache_.get());
+  for (auto& p : plots_) {
+    if (!p->is_cached()) {
+      p->plot(&gr, ctx);
+      p->set_dirty(false);
+    }
+  }
+  drawLegend(gr);
+}
+
+/* PNG writer for a save, with the size and compression of this figure      *
+ * PRE : layout() or layoutPanels() has been called                         *
+ * POST: writes to 'file', or to *pngSink_ if it is set (see savePng())      */
+std::unique_ptr<MglPngWriter> Figure::pngWriter(const std::string& file) const {
+  const int level = (compression_ == Compression::Fast) ? 1 : (compression_ == Compression::Best) ? 9 : 6;
+  if (!pngSink_) {
+    return std::unique_ptr<MglPngWriter>(new MglPngWriter(file, figWidth_, figHeight_, level));
+  }
+  std::vector<unsigned char>* sink = pngSink_;
+  return std::unique_ptr<MglPngWriter>(new MglPngWriter(
+    [sink](const unsigned char* data, std::size_t n) { sink->insert(sink->end(), data, data + n); return true; },
+    figWidth_, figHeight_, level));
+}
+
+/* render the figure in bands of tileHeight_ rows and stream them to a PNG  *
+ * PRE : layout() or layoutPanels() has been called, tileHeight_ > 0,       *
+ *       png has been opened with pngWriter()                                *
+ * POST: png holds the figure, returns its size in bytes (0 on failure).    *
+ *       The plots of layers_ bands are drawn in parallel, so at most        *
+ *       layers_ bands are in memory at a time. Subplot grids are rendered   *
+ *       band by band, see renderPanels()                                    */
+std::size_t Figure::saveTiled(MglPngWriter& png) {
+  if (!png.good()) {
+    return 0;
+  }
+
+  // the panels of a grid are placed and drawn in turn on one canvas, so
+  // only the bands of a single figure separate decorations from plots
+  const int bands = (figHeight_ + tileHeight_ - 1)/tileHeight_;
+  const int group = panels_.empty() ? std::max(1, std::min(layers_, bands)) : 1;
+  for (int first = 0; first < bands; first += group) {
+    const int n = std::min(group, bands - first);
+
+    // the canvases are prepared and decorated sequentially, as MathGL loads
+    // its fonts into shared state, only the plots are drawn in parallel
+    std::vector<std::unique_ptr<mglGraph> > canvases(n);
+    reserveArenas(std::size_t(n));
+    for (int i = 0; i < n; ++i) {
+      const int top = (first + i)*tileHeight_, rows = std::min(tileHeight_, figHeight_ - top);
+      canvases[i].reset(new mglGraph);
+      if (!panels_.empty()) {
+        renderPanels(*canvases[i], top, rows, false);
+      }
+      else {
+        prepare(*canvases[i], figWidth_, figHeight_, top, rows);
+        place(*canvases[i], 1, 1, 0, true);
+      }
+    }
+    if (panels_.empty()) {
+      parallel_chunks(std::size_t(n), unsigned(n),
+        [&](std::size_t begin, std::size_t end, unsigned) {
+          for (std::size_t i = begin; i < end; ++i) {
+            drawPlots(*canvases[i], unsigned(i));
+          }
+        });
+      for (auto& c : canvases) {
+        drawLegend(*c);
+      }
+    }
+
+    // rows have to be written in order
+    for (auto& c : canvases) {
+      png.write_rows(c->GetRGBA(), c->GetHeight());
+      c.reset();
+    }
+  }
+  return png.close();
+}
+
+/* save figure                                                              *
+ * PRE : -                                                                  *
+ * POST: write figure to 'file' in the format registered for its extension  *
+ *       (see MglWriterRegistry), unknown extensions are saved as eps with   *
+ *       .eps appended. renderStats() holds the number of bytes written      *
+ * NOTE: while an MglRenderPool exists, one of its worker processes       *
+ *       renders the figure. Otherwise, if the environment variable         *
+ *       FIGURE_RENDERD names the socket of a running figure-renderd, the   *
+ *       daemon renders the figure with its warm fonts and graphs. If it    *
+ *       can't be reached the figure is rendered here                       */
+void Figure::save(const std::string& file) {
+  // unknown extensions are saved as EPS, as they have always been
+  const MglWriterRegistry& writers = MglWriterRegistry::instance();
+  const MglFormat* format = writers.find(file);
+  std::string path = file;
+  if (!format) {
+    path += ".eps";
+    format = writers.find(path);
+    std::cerr << "* Figure - Warning * unknown file format, saving as " << path << "\n";
+  }
+
+  // cached figures redraw only what changed, which beats a full render in
+  // a pool worker or the daemon, so they stay in this process
+  const std::function<bool(std::ostream&)> scene = [this](std::ostream& out) { return serialize(out); };
+  MglRenderPool* pool = MglRenderPool::current();
+  std::size_t bytes = 0;
+  if (pool && !caching_ && pool->save(path, format->extension, scene, bytes)) {
+    // no retry in this process: a figure that crashed the workers would crash it as well
+    if (bytes == 0) {
+      std::cerr << "In function Figure::save(): Could not write " << path << "\n";
+    }
+    renderStats_ = MglRenderStats{ 0, 0, 0, bytes };
+    return;
+  }
+
+  const std::string socket = daemon_socket();
+  if (!socket.empty() && !caching_) {
+    bytes = daemon_save(socket, path, format->extension, scene);
+    if (bytes > 0) {
+      renderStats_ = MglRenderStats{ 0, 0, 0, bytes };
+      return;
+    }
+  }
+
+  saveAs(path, *format, nullptr);
+}
+
+/* save figure in a given format                                              *
+ * PRE : format is the extension of a registered format, e.g. ".png"          *
+ * POST: write figure to 'file' in 'format', whatever the name of the file.   *
+ *       If graph is not nullptr the figure is drawn on it instead of a new   *
+ *       graph, after resetting its settings, so long running renderers can  *
+ *       keep one warm graph per thread. Always renders in this process       */
+void Figure::save(const std::string& file, const std::string& format, mglGraph* graph) {
+  const MglFormat* f = MglWriterRegistry::instance().get(format);
+  if (!f) {
+    std::cerr << "In function Figure::save(): Unknown format " << format << "\n";
+    renderStats_ = MglRenderStats{ 0, 0, 0, 0 };
+    return;
+  }
+  if (graph) {
+    graph->DefaultPlotParam();
+  }
+  saveAs(file, *f, graph);
+}
+
+/* save figure as PNG in memory                                             *
+ * PRE : -                                                                   *
+ * POST: 'png' holds the figure as written by the built-in PNG encoder,    *
+ *       returns its size in bytes (0 on failure). Always renders in this    *
+ *       process                                                             */
+std::size_t Figure::savePng(std::vector<unsigned char>& png) {
+  png.clear();
+  pngSink_ = &png;
+  saveAs("<memory>", MglWriterRegistry::png(), nullptr);
+  pngSink_ = nullptr;
+  return renderStats_.bytesWritten;
+}
+
+/* render the figure and write it                                           *
+ * PRE : -                                                                  *
+ * POST: 'file' holds the figure in 'format', drawn on graph if it is not   *
+ *       nullptr, renderStats() holds the number of bytes written           */
+void Figure::saveAs(const std::string& path, const MglFormat& format, mglGraph* graph) {
+  // counts of this save only, other figures have arenas of their own
+  releaseArenas();
+
+  // vector formats store every point of a line, so lines are simplified to
+  // a quarter point (1 pixel = 1 point) which is not visible on paper
+  lineTolerance_ = format.vector ? 0.25 : 0;
+  vectorSave_ = format.vector;
+  for (auto& panel : panels_) {
+    if (panel) {
+      panel->lineTolerance_ = lineTolerance_;
     }
   }
 
+  if (!panels_.empty()) {
+    layoutPanels();
+  }
+  else {
+    layout();
+  }
+
+  // the settings fitBudget() may change for this save
+  const int layers = layers_, tileHeight = tileHeight_;
+  if (memoryBudget_ > 0) {
+    fitBudget(format);
+  }
+  pretransform();
+
+  // large PNGs are rendered band by band and streamed to the file, by the
+  // built-in encoder only: a .png writer of the user gets the whole image
+  const bool png = MglWriterRegistry::is_png(format);
+  const bool tiled = (tileHeight_ > 0 && tileHeight_ < figHeight_);
+  if (tiled && !png) {
+    std::cerr << "* Figure - Warning * tiled rendering is only supported for the built-in .png writer, rendering at once\n";
+  }
 
 #if NDEBUG
   std::cout << "Writing to file ... \n";
 #endif
 
-  // Checking if to plot in png or eps and save file
-  if(file.find(".png") != std::string::npos){
-    gr_.WritePNG(file.c_str());
+  std::size_t bytes = 0;
+  if (tiled && png) {
+    bytes = saveTiled(*pngWriter(path));
+  }
+  else {
+    std::unique_ptr<mglGraph> own; // graph in which the plots will be saved
+    if (!graph) {
+      own.reset(new mglGraph);
+      graph = own.get();
+    }
+    if (caching_ && panels_.empty() && !format.vector) {
+      // vector formats need the primitives, which a cached raster doesn't have
+      renderCached(*graph);
+    }
+    else {
+      render(*graph, 0, 0, !format.vector);
+    }
+    if (png) {
+      std::unique_ptr<MglPngWriter> writer = pngWriter(path);
+      writer->write_rows(graph->GetRGBA(), graph->GetHeight());
+      bytes = writer->close();
+    }
+    else {
+      bytes = format.write(*graph, path);
+    }
+  }
+  if (bytes == 0) {
+    std::cerr << "In function Figure::save(): Could not write " << path << "\n";
+  }
+
+  lineTolerance_ = 0;
+  vectorSave_ = false;
+  for (auto& panel : panels_) {
+    if (panel) {
+      panel->lineTolerance_ = 0;
+    }
   }
-  else if (file.find(".eps") != std::string::npos){
-    gr_.WriteEPS(file.c_str());
+  layers_ = layers;
+  tileHeight_ = tileHeight;
+  lowMemory_ = false;
+  clearTransform();
+
+  const MglArenaStats arenas = arenaStats();
+  renderStats_ = MglRenderStats{ arenas.requests, arenas.heapAllocations, arenas.bytes, bytes };
+  // all temporary buffers of this render pass are dropped at once
+  releaseArenas();
+}
+
+/* memory held by the figure and estimated for a save                        *
+ * PRE : format is the extension of a registered format, e.g. ".png"         *
+ * POST: plots holds the bytes of the data of every plot, the plots of the   *
+ *       panels follow in panel order. data is their sum plus the canvases   *
+ *       kept between saves (cache, animation). savePeak estimates what a    *
+ *       save in 'format' allocates on top of that with the current          *
+ *       settings: about 36 bytes per pixel of every canvas, 128 bytes per   *
+ *       point MathGL stores as primitive (not for raster formats drawn      *
+ *       directly, see setQuality() and setLayers()) and 24 bytes per point  *
+ *       for the clipped and simplified copies of the plots. Fonts and       *
+ *       other state of MathGL are not included                              */
+MglMemoryUsage Figure::memoryUsage(const std::string& format) {
+  if (!panels_.empty()) {
+    layoutPanels();
   }
   else {
-    gr_.WriteEPS((file + ".eps").c_str());
+    layout();
+  }
+
+  MglMemoryUsage usage{ std::vector<std::size_t>(), dataBytes(), 0 };
+  for (auto& p : plots_) {
+    usage.plots.push_back(p->memory());
+  }
+  for (auto& panel : panels_) {
+    if (panel) {
+      for (auto& p : panel->plots_) {
+        usage.plots.push_back(p->memory());
+      }
+    }
   }
+
+  const MglFormat* f = MglWriterRegistry::instance().get(format);
+  if (!f) {
+    std::cerr << "In function Figure::memoryUsage(): Unknown format " << format << "\n";
+    return usage;
+  }
+  usage.savePeak = savePeak(*f);
+  return usage;
+}
+
+/* bytes of the data held by the plots and the canvases kept between saves *
+ * PRE : -                                                                 *
+ * POST: includes the panels, see memoryUsage()                            */
+std::size_t Figure::dataBytes() const {
+  std::size_t bytes = canvas_bytes(cache_) + canvas_bytes(animGraph_) + canvas_bytes(animBackground_);
+  for (auto& p : plots_) {
+    bytes += p->memory();
+  }
+  for (auto& panel : panels_) {
+    if (panel) {
+      bytes += panel->dataBytes();
+    }
+  }
+  return bytes;
+}
+
+/* number of points the plots hand to MathGL at most, including the panels */
+std::size_t Figure::points() const {
+  std::size_t n = 0;
+  for (auto& p : plots_) {
+    n += p->points();
+  }
+  for (auto& panel : panels_) {
+    if (panel) {
+      n += panel->points();
+    }
+  }
+  return n;
+}
+
+/* estimate of the memory a save in 'format' allocates                      *
+ * PRE : layout() or layoutPanels() has been called                         *
+ * POST: see memoryUsage(), follows the canvases saveAs() creates           */
+std::size_t Figure::savePeak(const MglFormat& format) const {
+  const bool tiled = (tileHeight_ > 0 && tileHeight_ < figHeight_ && MglWriterRegistry::is_png(format));
+  std::size_t canvases = 1, rows = std::size_t(std::max(figHeight_, 0));
+  if (tiled) {
+    // layers_ bands at a time (one for a subplot grid), each with the
+    // primitives of the whole figure
+    const int bands = (figHeight_ + tileHeight_ - 1)/tileHeight_;
+    canvases = panels_.empty() ? std::size_t(std::max(1, std::min(layers_, bands))) : 1;
+    rows = std::size_t(tileHeight_);
+  }
+  // vector formats are drawn on one canvas, see saveAs()
+  else if (layers_ > 1 && !format.vector && !panels_.empty()) {
+    canvases += panels_.size(); // one per panel, see renderPanels()
+  }
+  else if (layers_ > 1 && !format.vector && plots_.size() > 1) {
+    canvases += std::min<std::size_t>(layers_, plots_.size());
+  }
+  else if (caching_ && panels_.empty() && !format.vector && !cache_) {
+    ++canvases; // the background, held by the figure after the save
+  }
+
+  // raster formats drawn directly to the canvas don't store the primitives,
+  // renderCached() always does so
+  const bool direct = !format.vector && ((mglQuality() & MGL_DRAW_LMEM) || (caching_ && panels_.empty()));
+  const std::size_t n = points();
+  return canvasBytes*std::size_t(std::max(figWidth_, 0))*rows*canvases
+         + (direct ? 0 : primitiveBytes*n*(tiled ? canvases : 1))
+         + scratchBytes*n;
+}
+
+/* reduce the data of the plots to the memory budget                        *
+ * PRE : memoryBudget_ > 0. If format is not nullptr, layout() or            *
+ *       layoutPanels() has been called                                      *
+ * POST: while the data (and the save in 'format' if it is not nullptr)     *
+ *       exceed the budget, line plots are decimated to the pixels of their *
+ *       plot region, largest first, then scatter plots are replaced by     *
+ *       density plots of 200 x 200 cells. Includes the plots of the        *
+ *       panels. Returns false if the budget is still exceeded               */
+bool Figure::reduceData(const MglFormat* format) {
+  const std::function<std::size_t()> needed = [&]() {
+    return dataBytes() + (format ? savePeak(*format) : 0);
+  };
+  if (needed() <= memoryBudget_) {
+    return true;
+  }
+
+  // the plots of this figure and of its panels, largest first
+  std::vector<std::pair<Figure*, std::size_t> > plots;
+  for (std::size_t i = 0; i < plots_.size(); ++i) {
+    plots.emplace_back(this, i);
+  }
+  for (auto& panel : panels_) {
+    for (std::size_t i = 0; panel && i < panel->plots_.size(); ++i) {
+      plots.emplace_back(panel.get(), i);
+    }
+  }
+  std::stable_sort(plots.begin(), plots.end(),
+    [](const std::pair<Figure*, std::size_t>& a, const std::pair<Figure*, std::size_t>& b) {
+      return a.first->plots_[a.second]->memory() > b.first->plots_[b.second]->memory();
+    });
+
+  int decimated = 0, rasterized = 0;
+  for (auto& p : plots) {
+    Figure& f = *p.first;
+    if (needed() <= memoryBudget_) {
+      break;
+    }
+    if (!f.has_3d_) {
+      const MglAxisMap mx(f.ranges_[0], f.ranges_[1], f.plotWidth_, f.xFunc_ == "lg(x)"),
+                       my(f.ranges_[2], f.ranges_[3], f.plotHeight_, f.yFunc_ == "lg(y)");
+      decimated += f.plots_[p.second]->decimate(mx, my);
+    }
+  }
+  for (auto& p : plots) {
+    Figure& f = *p.first;
+    if (needed() <= memoryBudget_) {
+      break;
+    }
+    // the cells of a density plot are linear in x and y
+    if (!f.has_3d_ && f.xFunc_ != "lg(x)" && f.yFunc_ != "lg(y)") {
+      MglPlot* density = f.plots_[p.second]->rasterize(200);
+      if (density) {
+        f.plots_[p.second].reset(density);
+        f.cache_.reset(); // the background may show the replaced plot
+        ++rasterized;
+      }
+    }
+  }
+
+  if (decimated + rasterized > 0) {
+    std::cerr << "* Figure - Warning * memory budget exceeded, " << decimated << " plots decimated to the pixels, "
+              << rasterized << " scatter plots drawn as density plots\n";
+    refreshRanges();
+    for (auto& panel : panels_) {
+      if (panel) {
+        panel->refreshRanges();
+      }
+    }
+  }
+  return needed() <= memoryBudget_;
+}
+
+/* fit the next save into the memory budget                                  *
+ * PRE : memoryBudget_ > 0, layout() or layoutPanels() has been called       *
+ * POST: for this save raster formats are drawn without storing the          *
+ *       primitives, on one canvas and PNGs in bands, as long as the budget  *
+ *       is exceeded, then the data are reduced by reduceData(). lowMemory_, *
+ *       layers_ and tileHeight_ are restored by the caller                  */
+void Figure::fitBudget(const MglFormat& format) {
+  const std::size_t data = dataBytes();
+  if (data + savePeak(format) <= memoryBudget_) {
+    return;
+  }
+
+  if (!format.vector && !(mglQuality() & MGL_DRAW_LMEM)) {
+    lowMemory_ = true;
+    std::cerr << "* Figure - Warning * memory budget exceeded, drawing without storing the primitives\n";
+  }
+  if (data + savePeak(format) > memoryBudget_ && layers_ > 1) {
+    layers_ = 1;
+    std::cerr << "* Figure - Warning * memory budget exceeded, rendering on one canvas\n";
+  }
+  if (data + savePeak(format) > memoryBudget_ && MglWriterRegistry::is_png(format) && figWidth_ > 0) {
+    // the highest bands that fit next to the data and the copies of the plots
+    const std::size_t fixed = data + scratchBytes*points(),
+                      free = memoryBudget_ > fixed ? memoryBudget_ - fixed : 0;
+    const int rows = int(std::min<std::size_t>(free/(canvasBytes*figWidth_), std::size_t(figHeight_)));
+    const int band = std::max(16, rows);
+    if (band < figHeight_ && (tileHeight_ <= 0 || band < tileHeight_)) {
+      tileHeight_ = band;
+      std::cerr << "* Figure - Warning * memory budget exceeded, rendering in bands of " << band << " rows\n";
+    }
+  }
+
+  if (!reduceData(&format)) {
+    std::cerr << "* Figure - Warning * memory budget of " << memoryBudget_ << " bytes exceeded, the save needs about "
+              << dataBytes() + savePeak(format) << " bytes\n";
+  }
+}
+
+/* decide on the pretransform of the log axes for a save                  *
+ * PRE : layout() or layoutPanels() has been called                       *
+ * POST: logData_ of this figure and its panels tells which axes are      *
+ *       drawn from log10 data, see setLogTransform(). The plots have     *
+ *       their log10 data ready, so they can be drawn from many threads   */
+void Figure::pretransform() {
+  const bool logx = (xFunc_ == "lg(x)"), logy = (yFunc_ == "lg(y)");
+  bool transform = logTransform_ && (logx || logy) && !has_3d_ && !plots_.empty()
+                   && (!logx || ranges_[0] > 0) && (!logy || ranges_[2] > 0);
+  for (auto& p : plots_) {
+    transform = transform && p->log_transform(logx, logy);
+  }
+  logData_ = {{ transform && logx, transform && logy }};
+
+  for (auto& panel : panels_) {
+    if (panel) {
+      panel->pretransform();
+    }
+  }
+}
+
+/* draw on the log axes of MathGL again, after a save */
+void Figure::clearTransform() {
+  logData_ = {{false, false}};
+  for (auto& panel : panels_) {
+    if (panel) {
+      panel->clearTransform();
+    }
+  }
+}
+
+/* allocation counts of the last call of save()                              *
+ * PRE : -                                                                   *
+ * POST: returns how many temporary buffers the plots used and how many heap *
+ *       allocations the render arenas needed for them. Only the arenas of   *
+ *       this figure and its panels are counted, also if other figures       *
+ *       render at the same time                                             */
+MglRenderStats Figure::renderStats() const {
+  return renderStats_;
 }
 
 } // end namespace mgl
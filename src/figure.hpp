@@ -8,6 +8,7 @@
 # include <stdexcept>
 # include <cassert>
 # include <numeric>
+# include <cstdio>
 
 # include "FigureConfig.hpp"
 # if FIG_HAS_EIGEN
@@ -15,48 +16,31 @@
   # include <Eigen/Sparse>
 # endif
 
+# include "MglData.hpp"
 # include "MglPlot.hpp"
+# include "MglSubmissions.hpp"
+# include "MglRender.hpp"
+# include "MglHistogram.hpp"
 # include "MglLabel.hpp"
 # include "MglStyle.hpp"
+# include "MglWriter.hpp"
+# include "MglPng.hpp"
 # include <mgl2/mgl.h>
 
 namespace mgl {
 
-/* make mglData from std::vector                                    *
- * PRE: -                                                           *
- * POST: returning mglData containing the data of given std::vector */
-template<typename Scalar>
-typename std::enable_if<std::is_arithmetic<Scalar>::value, mglData>::type
-make_mgldata(const std::vector<Scalar>& v) {
-  std::vector<double> vd(v.begin(), v.end());
-  return mglData(vd.data(), vd.size());
-}
+/* render quality of a Figure, see Figure::setQuality */
+enum class Quality { Preview, Normal, Publication };
 
-/* make mglData from Eigen::Vector or Eigen::RowVector                     *
- * PRE : -                                                                 *
- * POST: returning mglData containing the data of given Eigen::(Row)Vector */
-# if FIG_HAS_EIGEN
-template<typename Derived>
-mglData make_mgldata(const Eigen::MatrixBase<Derived>& vec) {
-  assert(vec.rows() == 1 || vec.cols() == 1);
-  std::vector<typename Derived::Scalar> v;
-  if(vec.rows() == 1) {
-    v.resize(vec.cols());
-    for(int i = 0; i < vec.cols(); i++)
-      v[i] = vec[i];
-  } else {
-    v.resize(vec.rows());
-    for(int i = 0; i < vec.rows(); i++)
-      v[i] = vec[i];
-  }
-  return mglData(v.data(), v.size());
-}
-# endif
+/* zlib compression of the PNGs of a Figure, see Figure::setCompression */
+enum class Compression { Fast, Default, Best };
 
 class Figure {
 public:
   Figure();
 
+  ~Figure();
+
   void setRanges(const mglData& xd, const mglData& yd, double vertMargin = 0.1);
 
   void setRanges(const mglData& xd, const mglData& yd, const mglData& zd);
@@ -90,10 +74,61 @@ public:
 
   MglPlot& fplot(const std::string& function, std::string style = "");
 
+  template <typename Vector>
+  MglPlot& hist(const Vector& data, const int nbins = 10, const std::string& style = "");
+
+  template <typename Vector>
+  MglPlot& hist(const Vector& data, const std::vector<double>& edges, const std::string& style = "");
+
+  MglPlot& hist(const MglHistogram& histogram, const std::string& style = "");
+
+# if FIG_HAS_EIGEN
+  template <typename Derived>
+  MglPlot& surf(const Eigen::MatrixBase<Derived>& Z, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& surf(Eigen::PlainObjectBase<Derived>&& Z, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& heatmap(const Eigen::MatrixBase<Derived>& Z, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& heatmap(Eigen::PlainObjectBase<Derived>&& Z, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& contour(const Eigen::MatrixBase<Derived>& Z, const int levels = 7, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& contour(Eigen::PlainObjectBase<Derived>&& Z, const int levels = 7, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& contour(const Eigen::MatrixBase<Derived>& Z, const std::vector<double>& levels, const std::string& style = "");
+
+  template <typename Derived>
+  MglPlot& contour(Eigen::PlainObjectBase<Derived>&& Z, const std::vector<double>& levels, const std::string& style = "");
+# endif
+
+  MglPlot& surf(const double* Z, const long rows, const long cols, const long rowStride, const std::string& style = "");
+
+  MglPlot& heatmap(const double* Z, const long rows, const long cols, const long rowStride, const std::string& style = "");
+
+  MglPlot& contour(const double* Z, const long rows, const long cols, const long rowStride, const int levels = 7, const std::string& style = "");
+
+  template <typename xVector, typename yVector>
+  MglPlot& density(const xVector& x, const yVector& y, const int bins = 200, const std::string& style = "");
+
   void ranges(const double& xMin, const double& xMax, const double& yMin, const double& yMax);
 
   void save(const std::string& file);
 
+  void save(const std::string& file, const std::string& format, mglGraph* graph = nullptr);
+
+  std::size_t savePng(std::vector<unsigned char>& png);
+
+  MglRenderStats renderStats() const;
+
+  MglMemoryUsage memoryUsage(const std::string& format = ".png");
+
   void setlog(bool logx = false, bool logy = false, bool logz = false);
 
   void setPlotHeight(const int height);
@@ -110,6 +145,22 @@ public:
 
   void setFontSize(const int size);
 
+  void setLayers(const int layers);
+
+  void setTileHeight(const int rows);
+
+  void setCaching(const bool cache);
+
+  void setConcurrent(const bool concurrent);
+
+  void setQuality(const Quality quality);
+
+  void setCompression(const Compression compression);
+
+  void setMemoryBudget(const std::size_t bytes);
+
+  void setLogTransform(const bool transform);
+
   template <typename Matrix> // dense version
   MglPlot& spy(const Matrix& A, const std::string& style = "b");
 
@@ -120,7 +171,93 @@ public:
 
   void title(const std::string& text);
 
+  Figure& subplot(const int rows, const int cols, int idx);
+
+  void beginAnimation(const std::string& file, const int fps = 25);
+
+  void frame();
+
+  void endAnimation();
+
+  void clearPlots();
+
+  bool remove(const MglPlot& plot);
+
+  bool serialize(std::ostream& out);
+
+  bool deserialize(std::istream& in);
+
 private:
+  void layout();
+
+  void prepare(mglGraph& gr, const int width, const int height, const int top = 0, const int rows = 0);
+
+  int mglQuality() const;
+
+  void place(mglGraph& gr, const int rows, const int cols, const int idx, bool decorate);
+
+  void drawPlots(mglGraph& gr, const unsigned slot = 0);
+
+  MglRenderContext renderContext(const unsigned slot = 0) const;
+
+  void reserveArenas(const std::size_t n);
+
+  void releaseArenas();
+
+  MglArenaStats arenaStats() const;
+
+  MglPlot& submit(MglSubmissions::Ticket ticket, MglPlot* plot, const bool lineStyle);
+
+  void collect();
+
+  MglFieldPlot& field(MglSubmissions::Ticket ticket, MglFieldPlot* plot);
+
+  void setRanges(const MglPlot& plot, const bool warn = true);
+
+  void widenRanges(const std::array<MglRange, 3>& extent, const bool warn);
+
+  void updateRanges();
+
+  void refreshRanges();
+
+  void write(MglSceneWriter& out) const;
+
+  bool read(MglSceneReader& in);
+
+  void drawLegend(mglGraph& gr);
+
+  void renderLayers(mglGraph& gr);
+
+  void layoutPanels();
+
+  void renderPanels(mglGraph& gr, const int top, const int rows, const bool layered);
+
+  void render(mglGraph& gr, const int top, const int rows, const bool layered);
+
+  std::size_t saveTiled(MglPngWriter& png);
+
+  std::unique_ptr<MglPngWriter> pngWriter(const std::string& file) const;
+
+  void saveAs(const std::string& path, const MglFormat& format, mglGraph* graph);
+
+  std::string layoutKey() const;
+
+  std::size_t dataBytes() const;
+
+  std::size_t points() const;
+
+  std::size_t savePeak(const MglFormat& format) const;
+
+  bool reduceData(const MglFormat* format);
+
+  void fitBudget(const MglFormat& format);
+
+  void pretransform();
+
+  void clearTransform();
+
+  void renderCached(mglGraph& gr);
+
   bool axis_; // plot axis?
   bool grid_; // plot grid?
   bool legend_; // plot legend
@@ -131,6 +268,9 @@ private:
   std::array<double, 4> ranges_; // axis ranges
   std::array<double, 2> zranges_; // z axis ranges
   std::array<double, 3> aspects_; // axis aspects, e.g. -1 used to invert axis. see MathGL docu
+  std::array<double, 2> view_; // rotation around the x and z axis of 3d plots, in degrees
+  double lineTolerance_; // simplification of 2d lines during save(), see MglRenderContext
+  bool vectorSave_; // does the current save() write a vector format, which needs the primitives?
   bool autoRanges_; // auto ranges or ranges as the user set them?
   std::string title_; // title of the plot
   std::string xFunc_, yFunc_, zFunc_; // curvature of coordinate axis
@@ -142,6 +282,28 @@ private:
   int leftMargin_, topMargin_; // left and top margin of plot inside the image
   std::vector<std::unique_ptr<MglPlot> > plots_; // x, y (and z) data for the plots
   std::vector<std::pair<std::string, std::string>> additionalLabels_; // manually added labels 
+  MglSubmissions submissions_; // plots and labels not yet in plots_ and additionalLabels_
+  bool concurrent_; // may plots be submitted from several threads?
+  int layers_; // number of canvases the plots are rendered on in parallel, <= 1 means sequential
+  int tileHeight_; // height of the bands of tiled rendering, <= 0 means no tiling
+  bool caching_; // keep the unchanged part of the graphic between saves?
+  std::unique_ptr<mglGraph> cache_; // background: decorations and unchanged plots
+  std::string cacheKey_; // layoutKey() cache_ has been drawn with
+  int rows_, cols_; // layout of the subplot grid
+  std::vector<std::unique_ptr<Figure> > panels_; // subplots, drawn in their cell of the grid
+  std::unique_ptr<mglGraph> animGraph_; // graph kept between the frames of an animation
+  std::unique_ptr<mglGraph> animBackground_; // title, labels, grid, axis and box of the animation
+  std::array<double, 6> animRanges_; // ranges animBackground_ has been drawn with
+  std::FILE* animStream_; // raw RGBA output of the animation, nullptr for GIF
+  Quality quality_; // render quality
+  Compression compression_; // zlib compression of PNGs
+  std::vector<unsigned char>* pngSink_; // PNG written to memory by savePng(), nullptr for a file
+  std::size_t memoryBudget_; // bytes the figure may use including its saves, 0 for no limit
+  bool lowMemory_; // draw without storing the primitives, set by fitBudget() for one save
+  bool logTransform_; // draw 2d plots on log axes from log10 of their data?
+  std::array<bool, 2> logData_; // x and y pretransformed in the current save, see pretransform()
+  MglRenderStats renderStats_; // allocation counts of the last save()
+  std::vector<std::unique_ptr<MglArena> > arenas_; // scratch memory of the threads drawing plots, see reserveArenas()
 };
 
 /* bar plot for given y data                                                       *
@@ -164,6 +326,7 @@ template <typename xVector, typename yVector>
 typename std::enable_if<!std::is_same<typename std::remove_pointer<typename std::decay<yVector>::type>::type, char >::value, MglPlot&>::type
 Figure::bar(const xVector& x, const yVector& y, std::string style)
 {
+  MglSubmissions::Ticket ticket = submissions_.ticket();
   if (x.size() != y.size()) {
     std::cerr << "In function Figure::plot(): Vectors must have same sizes!";
   }
@@ -172,24 +335,9 @@ Figure::bar(const xVector& x, const yVector& y, std::string style)
   mglData xd = make_mgldata(x);
   mglData yd = make_mgldata(y);
 
-  // if the ranges are set to auto set the new ranges 
-  if(autoRanges_){
-    setRanges(xd, yd, 0.); // the 0 stands no top+bottom margin
-  }
-  
-  // check if a style is given,
-  // if yes: add that style to the style queue and remove it from the style-deque,
-  // if no : get a new style from the style-deque
-  if (style.size() == 0) {
-    style = styles_.get_next();
-  }
-  else {
-    styles_.eliminate(style);
-  }
-
-  // put the x-y data in the plot queue
-  plots_.emplace_back(std::unique_ptr<MglBarPlot>(new MglBarPlot(xd, yd, style)));
-  return *plots_.back().get();
+  // put the x-y data in the plot queue, without a style a new one is
+  // taken from the style-deque, otherwise it is removed from the deque
+  return submit(std::move(ticket), new MglBarPlot(std::move(xd), std::move(yd), style), true);
 }
 
 /* plot y data                                                         *
@@ -204,14 +352,16 @@ MglPlot& Figure::plot(const yVector& y, std::string style)
   return plot(x, y, style);
 }
 
-/* plot x,y data                                           *
- * PRE : -                                                 *
- * POST: add x-y to plot queue with given style (optional) */
+/* plot x,y data                                                           *
+ * PRE : -                                                                 *
+ * POST: add x-y to plot queue with given style (optional). Points with NaN *
+ *       or Inf are gaps in the line and left out of the automatic ranges   */
 template <typename xVector, typename yVector>
 // the long template magic expression ensures this function is not called if yVector is a string (which would be allowed as it is a templated argument)
 typename std::enable_if<!std::is_same<typename std::remove_pointer<typename std::decay<yVector>::type>::type, char >::value, MglPlot&>::type
 Figure::plot(const xVector& x, const yVector& y, std::string style)
 {
+  MglSubmissions::Ticket ticket = submissions_.ticket();
   // make sure the sizes of the vectors are the same
   if (x.size() != y.size()){
     std::cerr << "In function Figure::plot(): Vectors must have same sizes!";
@@ -221,24 +371,9 @@ Figure::plot(const xVector& x, const yVector& y, std::string style)
   mglData xd = make_mgldata(x);
   mglData yd = make_mgldata(y);
 
-  // if the ranges are set to auto set the new ranges 
-  if(autoRanges_){
-    setRanges(xd, yd, 0.); // the 0 stands no top+bottom margin
-  }
-  
-  // check if a style is given,
-  // if yes: add that style to the style queue and remove it from the style-deque,
-  // if no : get a new style from the style-deque
-  if (style.size() == 0) {
-    style = styles_.get_next();
-  }
-  else {
-    styles_.eliminate(style);
-  }
-
-  // put the x-y data in the plot queue
-  plots_.emplace_back(std::unique_ptr<MglPlot2d>(new MglPlot2d(xd, yd, style)));
-  return *plots_.back().get();
+  // put the x-y data in the plot queue, without a style a new one is
+  // taken from the style-deque, otherwise it is removed from the deque
+  return submit(std::move(ticket), new MglPlot2d(std::move(xd), std::move(yd), style), true);
 }
 
 /* plot x,y,z data                                           *
@@ -247,9 +382,7 @@ Figure::plot(const xVector& x, const yVector& y, std::string style)
 template <typename xVector, typename yVector, typename zVector>
 MglPlot& Figure::plot3(const xVector& x, const yVector& y, const zVector& z, std::string style)
 {
-
-  has_3d_ = true; // needed to set zranges in save-function and call mgl::Rotate
-
+  MglSubmissions::Ticket ticket = submissions_.ticket();
   // make sure the sizes of the vectors are the same
   if (!(x.size() == y.size() && y.size() == z.size())){
     std::cerr << "In function Figure::plot(): Vectors must have same sizes!";
@@ -260,24 +393,171 @@ MglPlot& Figure::plot3(const xVector& x, const yVector& y, const zVector& z, std
   mglData yd = make_mgldata(y);
   mglData zd = make_mgldata(z);
 
-  // if the ranges are set to auto set the new ranges
-  if(autoRanges_){
-    setRanges(xd, yd, zd);
+  // put the x-y-z data in the plot queue, a 3d plot sets the zranges and
+  // the point of view of the figure
+  return submit(std::move(ticket), new MglPlot3d(std::move(xd), std::move(yd), std::move(zd), style), true);
+}
+
+/* histogram of data with nbins bins                                          *
+ * PRE : nbins > 0                                                             *
+ * POST: the bins span the range of the finite data, with equal width in log  *
+ *       space if the x axis is log scaled (see setlog, call it before). The   *
+ *       counts are added as bar plot to the plot queue, the data is not kept  */
+template <typename Vector>
+MglPlot& Figure::hist(const Vector& data, const int nbins, const std::string& style)
+{
+  const bool logBins = (xFunc_ == "lg(x)");
+  std::array<double, 2> range = extent1d(data, std::size_t(data.size()), logBins);
+  if (range[0] > range[1]) {
+    std::cerr << "In function Figure::hist(): No finite " << (logBins ? "positive " : "") << "data!";
+    range = {1, 1};
   }
 
-  // check if a style is given,
-  // if yes: add that style to the style queue and remove it from the style-deque,
-  // if no : get a new style from the style-deque
-  if (style.size() == 0) {
-    style = styles_.get_next();
+  MglHistogram histogram(range[0], range[1], nbins, logBins);
+  histogram.add(data);
+  return hist(histogram, style);
+}
+
+/* histogram of data in the bins between the given edges        *
+ * PRE : edges sorted, at least 2 edges                         *
+ * POST: the counts are added as bar plot to the plot queue     */
+template <typename Vector>
+MglPlot& Figure::hist(const Vector& data, const std::vector<double>& edges, const std::string& style)
+{
+  MglHistogram histogram(edges);
+  histogram.add(data);
+  return hist(histogram, style);
+}
+
+# if FIG_HAS_EIGEN
+/* surface plot of Z                                                        *
+ * PRE : -                                                                  *
+ * POST: add the surface z = Z(i,j) over x = j+1 (columns) and y = i+1      *
+ *       (rows) to the plot queue, 'style' is a MathGL color scheme. A      *
+ *       row-major Matrix or Map of doubles is not copied and must not be   *
+ *       changed or freed until the figure is saved, see make_field_plot()  */
+template <typename Derived>
+MglPlot& Figure::surf(const Eigen::MatrixBase<Derived>& Z, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  return field(std::move(ticket), make_field_plot(Z, MglFieldPlot::Surf, style, true));
+}
+
+/* temporary matrices are copied */
+template <typename Derived>
+MglPlot& Figure::surf(Eigen::PlainObjectBase<Derived>&& Z, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  return field(std::move(ticket), make_field_plot(Z, MglFieldPlot::Surf, style, false));
+}
+
+/* heatmap of Z                                                          *
+ * PRE : -                                                               *
+ * POST: add the colormapped image of Z to the plot queue, column j is   *
+ *       at x = j+1 and row i at y = i+1, 'style' is a MathGL color scheme. *
+ *       Z is linked as for surf                                          */
+template <typename Derived>
+MglPlot& Figure::heatmap(const Eigen::MatrixBase<Derived>& Z, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  return field(std::move(ticket), make_field_plot(Z, MglFieldPlot::Heatmap, style, true));
+}
+
+template <typename Derived>
+MglPlot& Figure::heatmap(Eigen::PlainObjectBase<Derived>&& Z, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  return field(std::move(ticket), make_field_plot(Z, MglFieldPlot::Heatmap, style, false));
+}
+
+/* contour plot of Z                                                       *
+ * PRE : levels > 0                                                        *
+ * POST: add 'levels' contour lines evenly spaced between the extreme values *
+ *       of Z to the plot queue, coordinates as for heatmap. Z is linked   *
+ *       as for surf                                                       *
+ * NOTE: as for all field plots, grids finer than the output pixels are    *
+ *       averaged in blocks before rendering                               */
+template <typename Derived>
+MglPlot& Figure::contour(const Eigen::MatrixBase<Derived>& Z, const int levels, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  MglFieldPlot* p = make_field_plot(Z, MglFieldPlot::Contour, style, true);
+  p->levels(levels);
+  return field(std::move(ticket), p);
+}
+
+template <typename Derived>
+MglPlot& Figure::contour(Eigen::PlainObjectBase<Derived>&& Z, const int levels, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  MglFieldPlot* p = make_field_plot(Z, MglFieldPlot::Contour, style, false);
+  p->levels(levels);
+  return field(std::move(ticket), p);
+}
+
+/* contour plot of Z at the given levels                   *
+ * PRE : -                                                 *
+ * POST: add the contour lines of Z to the plot queue      */
+template <typename Derived>
+MglPlot& Figure::contour(const Eigen::MatrixBase<Derived>& Z, const std::vector<double>& levels, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  MglFieldPlot* p = make_field_plot(Z, MglFieldPlot::Contour, style, true);
+  p->levels(levels);
+  return field(std::move(ticket), p);
+}
+
+template <typename Derived>
+MglPlot& Figure::contour(Eigen::PlainObjectBase<Derived>&& Z, const std::vector<double>& levels, const std::string& style)
+{
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  MglFieldPlot* p = make_field_plot(Z, MglFieldPlot::Contour, style, false);
+  p->levels(levels);
+  return field(std::move(ticket), p);
+}
+# endif
+
+/* density plot of x,y data                                                   *
+ * PRE : bins > 0                                                            *
+ * POST: the points are counted in a grid of bins x bins cells, which is     *
+ *       added to the plot queue as one colormapped image. Only the counts   *
+ *       are kept. The grid covers the ranges if they have been set before,  *
+ *       otherwise the extent of the data                                    *
+ * NOTE: for millions of points this is much faster and smaller than marker *
+ *       plots, as its cost does not depend on the number of points anymore. *
+ *       Counting is one parallel sweep over the data. Without ranges set    *
+ *       the extent needs a sweep of its own before, as the cells are only   *
+ *       known once the extent is, so auto-ranged density plots read the     *
+ *       data twice                                                          */
+template <typename xVector, typename yVector>
+MglPlot& Figure::density(const xVector& x, const yVector& y, const int bins, const std::string& style)
+{
+  if (x.size() != y.size()) {
+    std::cerr << "In function Figure::density(): Vectors must have same sizes!";
+  }
+  MglSubmissions::Ticket ticket = submissions_.ticket();
+  const std::size_t n = std::min<std::size_t>(x.size(), y.size());
+
+  // grid on the data or on the ranges set by the user, the extent of the
+  // data is a sweep of its own before the counting one
+  std::array<double, 4> box = autoRanges_ ? extent2d(x, y, n) : ranges_;
+  if (box[0] > box[1] || box[2] > box[3]) {
+    box = {0, 1, 0, 1}; // no finite data
   }
-  else {
-    styles_.eliminate(style);
+  // avoid empty cells if all points have the same x or y
+  for (int d = 0; d < 4; d += 2) {
+    if (box[d] == box[d + 1]) {
+      box[d] -= 0.5;
+      box[d + 1] += 0.5;
+    }
   }
 
-  // put the x-y-z data in the plot queue
-  plots_.emplace_back(std::unique_ptr<MglPlot3d>(new MglPlot3d(xd, yd, zd, style)));
-  return *plots_.back().get();
+  const int nbins = std::max(1, bins);
+  mglData counts(nbins, nbins);
+  bin2d(x, y, n, box, nbins, nbins, counts.a);
+
+  // a color scheme, not a line style: the style-deque is not used
+  return submit(std::move(ticket), new MglDensity(counts, box, style.size() == 0 ? "BbcyrR" : style), false);
 }
 
 template <typename Matrix>
@@ -323,8 +603,7 @@ MglPlot& Figure::spy(const Matrix& A, const std::string& style) {
   label << counter;
   xMglLabel_ = MglLabel(label.str());
 
-  plots_.emplace_back(std::unique_ptr<MglSpy>(new MglSpy(xd, yd, style + radius)));
-  return *plots_.back().get();
+  return submit(submissions_.ticket(), new MglSpy(xd, yd, A.rows(), A.cols(), style + radius), false);
 }
 
 # if FIG_HAS_EIGEN
@@ -368,8 +647,7 @@ MglPlot& Figure::spy(const Eigen::SparseMatrix<Scalar>& A, const std::string& st
   label << counter;
   xMglLabel_ = MglLabel(label.str());
 
-  plots_.emplace_back(std::unique_ptr<MglSpy>(new MglSpy(xd, yd, style + radius)));
-  return *plots_.back().get();
+  return submit(submissions_.ticket(), new MglSpy(xd, yd, A.rows(), A.cols(), style + radius), false);
 }
 # endif
 
@@ -0,0 +1,172 @@
+/* figure-render: render many figures in one process                        *
+ *                                                                           *
+ * usage: figure-render [-j workers] manifest                                *
+ *                                                                           *
+ * Every line of the manifest is one job: the scene file of a figure, as     *
+ * written by Figure::serialize, and the output file, whose extension        *
+ * selects the format. Empty lines and lines starting with '#' are skipped:  *
+ *                                                                           *
+ *   # scene          output                                                 *
+ *   runtimes.scene   runtimes.png                                           *
+ *   errors.scene     errors.svg                                             *
+ *                                                                           *
+ * The jobs are rendered by an MglRenderPool of 'workers' worker processes  *
+ * (default: all cores), each one renders one figure at a time and loads    *
+ * the fonts once. MathGL keeps process wide state, so figures are never    *
+ * rendered by several threads of one process: compressed formats, which   *
+ * the workers can't write, are rendered by this process one at a time.    *
+ * Prints the time of every job and a summary, exits with 1 if a job failed  *
+ * and with 2 on usage errors.                                               */
+
+# include <iostream>
+# include <fstream>
+# include <sstream>
+# include <string>
+# include <vector>
+# include <thread>
+# include <mutex>
+# include <atomic>
+# include <chrono>
+# include <cstdlib>
+# include <algorithm>
+# include "figure.hpp"
+# include "MglDaemon.hpp"
+# include "MglParallel.hpp"
+# include "MglPool.hpp"
+
+namespace {
+
+struct Job {
+  std::string scene; // scene file
+  std::string output; // output file
+  int line; // line in the manifest
+};
+
+/* jobs of a manifest                                                   *
+ * PRE : -                                                              *
+ * POST: returns false and prints the line if the manifest is invalid   */
+bool readManifest(const std::string& file, std::vector<Job>& jobs)
+{
+  std::ifstream in(file.c_str());
+  if (!in) {
+    std::cerr << "figure-render: Could not open manifest " << file << "\n";
+    return false;
+  }
+
+  std::string text;
+  for (int line = 1; std::getline(in, text); ++line) {
+    std::istringstream fields(text);
+    Job job;
+    job.line = line;
+    if (!(fields >> job.scene) || job.scene[0] == '#') {
+      continue;
+    }
+    std::string rest;
+    if (!(fields >> job.output) || (fields >> rest && rest[0] != '#')) {
+      std::cerr << "figure-render: " << file << ":" << line << ": expected '<scene> <output>'\n";
+      return false;
+    }
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+/* render one job                                                        *
+ * PRE : pool is the current render pool                                 *
+ * POST: returns the number of bytes written, 0 on failure. Figure::save *
+ *       hands the figure to a worker of the pool, figures it can't take *
+ *       are rendered in this process, holding inProcess                 */
+std::size_t render(const Job& job, const mgl::MglRenderPool& pool, std::mutex& inProcess)
+{
+  std::ifstream in(job.scene.c_str(), std::ios::binary);
+  if (!in) {
+    std::cerr << "figure-render: Could not open scene " << job.scene << "\n";
+    return 0;
+  }
+  mgl::Figure fig;
+  if (!fig.deserialize(in)) {
+    return 0;
+  }
+  // rendered once, a cached background would only keep it in this process
+  fig.setCaching(false);
+
+  // unknown extensions are saved as EPS, which the workers write
+  const mgl::MglFormat* format = mgl::MglWriterRegistry::instance().find(job.output);
+  if (pool.good() && (!format || mgl::daemon_format(format->extension))) {
+    fig.save(job.output);
+  }
+  else {
+    std::lock_guard<std::mutex> lock(inProcess);
+    fig.save(job.output);
+  }
+  return fig.renderStats().bytesWritten;
+}
+
+} // end namespace
+
+int main(int argc, char* argv[])
+{
+  unsigned workers = mgl::hardware_threads();
+  std::string manifest;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      workers = unsigned(std::max(1, std::atoi(argv[++i])));
+    }
+    else if (manifest.empty() && arg[0] != '-') {
+      manifest = arg;
+    }
+    else {
+      manifest.clear();
+      break;
+    }
+  }
+  if (manifest.empty()) {
+    std::cerr << "usage: figure-render [-j workers] manifest\n";
+    return 2;
+  }
+
+  std::vector<Job> jobs;
+  if (!readManifest(manifest, jobs)) {
+    return 2;
+  }
+
+  // the pool forks its workers, so it is started before any thread
+  workers = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(workers, jobs.size())));
+  mgl::MglRenderPool pool(workers);
+  if (!pool.good()) {
+    std::cerr << "figure-render: Could not start the workers, rendering one figure at a time\n";
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  std::atomic<std::size_t> next(0), failed(0), bytes(0);
+  std::mutex print; // one line per job, not interleaved
+  std::mutex inProcess; // figures rendered by this process
+
+  // one thread per worker hands it the next job until all are done, so
+  // long jobs don't hold up the others
+  mgl::parallel_chunks(workers, workers, [&](std::size_t, std::size_t, unsigned) {
+    for (std::size_t k = next++; k < jobs.size(); k = next++) {
+      const Clock::time_point begin = Clock::now();
+      const std::size_t written = render(jobs[k], pool, inProcess);
+      const double ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+      bytes += written;
+      if (written == 0) {
+        ++failed;
+      }
+      std::lock_guard<std::mutex> lock(print);
+      std::cout << (written > 0 ? "ok     " : "FAILED ") << jobs[k].output
+                << "  " << ms << " ms  " << written << " bytes"
+                << "  (" << manifest << ":" << jobs[k].line << ")\n";
+    }
+  });
+
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << jobs.size() << " jobs, " << failed << " failed, " << seconds << " s on "
+            << workers << " workers, " << (seconds > 0 ? jobs.size()/seconds : 0.) << " figures/s, "
+            << (seconds > 0 ? bytes/seconds/1e6 : 0.) << " MB/s written\n";
+
+  return failed > 0 ? 1 : 0;
+}
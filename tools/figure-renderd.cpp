@@ -0,0 +1,149 @@
+/* figure-renderd: render daemon for Figure::save                           *
+ *                                                                           *
+ * usage: figure-renderd [-j workers] socket                                 *
+ *                                                                           *
+ * Listens on the Unix socket 'socket' and renders the figures of its        *
+ * clients, see MglDaemon.hpp for the protocol. The workers are processes,   *
+ * forked before any thread is started, as MathGL keeps process wide state.  *
+ * Every worker loads the fonts once and keeps its own graph, so a figure    *
+ * costs its rendering only, not the start of a process and the loading of  *
+ * the fonts. A worker that crashes is replaced. To use it from programs     *
+ * using Figure, start it and set FIGURE_RENDERD:                            *
+ *                                                                           *
+ *   figure-renderd /tmp/figure.sock &                                       *
+ *   FIGURE_RENDERD=/tmp/figure.sock ./my_program                            *
+ *                                                                           *
+ * Only processes of the same user may connect. Stops on SIGINT or SIGTERM  *
+ * and removes the socket, exits with 2 on usage errors.                     */
+
+# include <iostream>
+# include <string>
+# include <vector>
+# include <algorithm>
+# include <cstdlib>
+# include <cstring>
+# include <csignal>
+# include <sys/wait.h>
+# include "figure.hpp"
+# include "MglDaemon.hpp"
+# include "MglParallel.hpp"
+
+namespace {
+
+/* serve connections until the daemon stops                              *
+ * PRE : listener is a listening SOCK_SEQPACKET Unix socket              *
+ * POST: every request of the accepted connections has been answered,    *
+ *       returns when the listener has been shut down                    */
+void serve(const int listener)
+{
+  mglGraph graph; // kept warm for all figures of this worker
+  mgl::daemon_warm_up(graph);
+
+  for (;;) {
+    const int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // the listener has been shut down
+    }
+
+    // only the user running the daemon may write files through it
+    ucred peer;
+    socklen_t length = sizeof(peer);
+    if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || peer.uid != getuid()) {
+      close(connection);
+      continue;
+    }
+
+    mgl::daemon_serve(connection, graph);
+    close(connection);
+  }
+}
+
+/* start a worker process serving the listener                   *
+ * PRE : the calling process is single threaded                  *
+ * POST: returns the pid of the worker, -1 if it could not fork  */
+pid_t spawn(const int listener)
+{
+  const pid_t pid = fork();
+  if (pid == 0) {
+    serve(listener);
+    _exit(0);
+  }
+  return pid;
+}
+
+} // end namespace
+
+int main(int argc, char* argv[])
+{
+  unsigned workers = mgl::hardware_threads();
+  std::string path;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      workers = unsigned(std::max(1, std::atoi(argv[++i])));
+    }
+    else if (path.empty() && arg[0] != '-') {
+      path = arg;
+    }
+    else {
+      path.clear();
+      break;
+    }
+  }
+  sockaddr_un address;
+  if (path.empty() || !mgl::daemon_address(path, address)) {
+    std::cerr << "usage: figure-renderd [-j workers] socket\n";
+    return 2;
+  }
+
+  // the workers inherit the blocked signals and leave them to the daemon,
+  // which also learns from SIGCHLD that a worker died
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+
+  const int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  unlink(path.c_str()); // left over by a daemon that has been killed
+  const mode_t mask = umask(0077); // only the user may connect
+  const bool bound = listener >= 0
+                     && bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+  umask(mask);
+  if (!bound || listen(listener, 64) != 0) {
+    std::cerr << "figure-renderd: Could not listen on " << path << ": " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  std::cout << "figure-renderd: listening on " << path << " with " << workers << " workers" << std::endl;
+
+  unsigned live = 0;
+  for (unsigned k = 0; k < workers; ++k) {
+    live += spawn(listener) > 0;
+  }
+
+  int signal = 0;
+  while (live > 0 && sigwait(&signals, &signal) == 0 && signal == SIGCHLD) {
+    // replace the workers killed by a signal, e.g. a crash of MathGL
+    int status = 0;
+    while (waitpid(-1, &status, WNOHANG) > 0) {
+      if (WIFSIGNALED(status)) {
+        std::cerr << "figure-renderd: a worker died, starting a new one\n";
+        live -= spawn(listener) <= 0;
+      }
+      else {
+        --live;
+      }
+    }
+  }
+
+  // wakes the workers waiting in accept(), connections being served are finished
+  shutdown(listener, SHUT_RDWR);
+  while (wait(nullptr) > 0) {}
+  close(listener);
+  unlink(path.c_str());
+  return 0;
+}